@@ -0,0 +1,485 @@
+// Benchmark harness behind `make bench`. It is linked against all shell
+// sources (shellish-skeleton.c compiled with main renamed) and times the
+// hot paths directly. Every result is one JSON object per line on stdout:
+//
+//   {"variant":"lto","bench":"parse","case":"words=16","unit":"ns/op",...}
+//
+// and a readable line on stderr. `shellish-bench [name]` runs only the
+// benchmarks whose name contains `name`.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "process_tree.h"
+#include "shellish.h"
+
+#ifndef BENCH_VARIANT
+#define BENCH_VARIANT "default"
+#endif
+
+#define BENCH_MIN_TIME 0.3          // seconds spent in each timed loop
+#define BENCH_CUT_BYTES (32 << 20)  // size of each generated TSV file
+#define BENCH_CHAT_MESSAGES 200     // messages per chatroom case
+
+extern char **environ;
+
+static const char *bench_filter;
+
+/* ─── Harness ─── */
+
+/**
+ * @return CLOCK_MONOTONIC in seconds
+ */
+static double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @param  name benchmark name
+ * @return      whether it was selected on the command line
+ */
+static bool bench_selected(const char *name) {
+  return bench_filter == NULL || strstr(name, bench_filter) != NULL;
+}
+
+/**
+ * Emit one result as a JSON line on stdout and a readable line on stderr
+ * @param bench benchmark name
+ * @param cas   case within the benchmark
+ * @param unit  unit of value
+ * @param value measured value
+ */
+static void bench_report(const char *bench, const char *cas,
+                         const char *unit, double value) {
+  printf("{\"variant\":\"%s\",\"bench\":\"%s\",\"case\":\"%s\","
+         "\"unit\":\"%s\",\"value\":%.3f}\n",
+         BENCH_VARIANT, bench, cas, unit, value);
+  fflush(stdout);
+  fprintf(stderr, "%-8s %-10s %-24s %14.3f %s\n", BENCH_VARIANT, bench, cas,
+          value, unit);
+}
+
+/**
+ * Call fn repeatedly for at least BENCH_MIN_TIME seconds
+ * @param  fn  benchmarked operation
+ * @param  ctx argument for fn
+ * @return     mean time per call in nanoseconds
+ */
+static double bench_loop(void (*fn)(void *), void *ctx) {
+  fn(ctx); // warm up caches, the PATH cache and the arena
+  long iters = 0;
+  double start = bench_now(), elapsed;
+  do {
+    for (int i = 0; i < 16; i++)
+      fn(ctx);
+    iters += 16;
+    elapsed = bench_now() - start;
+  } while (elapsed < BENCH_MIN_TIME);
+  return elapsed * 1e9 / iters;
+}
+
+static int quiet_saved = -1;
+
+/**
+ * Send stdout to /dev/null while a benchmarked command prints
+ */
+static void bench_quiet_begin() {
+  fflush(stdout);
+  quiet_saved = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+}
+
+/**
+ * Restore stdout after bench_quiet_begin()
+ */
+static void bench_quiet_end() {
+  fflush(stdout);
+  dup2(quiet_saved, STDOUT_FILENO);
+  close(quiet_saved);
+}
+
+/* ─── Parser ─── */
+
+struct parse_ctx {
+  const char *line;
+  size_t len;
+  char buf[4096];
+};
+
+static void parse_once(void *arg) {
+  struct parse_ctx *ctx = arg;
+  struct command_t command;
+  memset(&command, 0, sizeof(command));
+  memcpy(ctx->buf, ctx->line, ctx->len + 1); // parsing may write into it
+  parse_command(ctx->buf, &command);
+  free_command(&command);
+}
+
+/**
+ * parse_command() on synthetic lines: plain words of growing count, and a
+ * line with quotes, a pipe and redirections
+ */
+static void bench_parse() {
+  static const int words[] = {4, 16, 64};
+  char line[4096], cas[64];
+  for (size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++) {
+    size_t len = snprintf(line, sizeof(line), "command");
+    for (int i = 0; i < words[w]; i++)
+      len += snprintf(line + len, sizeof(line) - len, " argument%d", i);
+    struct parse_ctx ctx = {line, len, {0}};
+    double ns = bench_loop(parse_once, &ctx);
+    snprintf(cas, sizeof(cas), "words=%d", words[w]);
+    bench_report("parse", cas, "ns/op", ns);
+    bench_report("parse", cas, "MB/s", len / ns * 1e3);
+  }
+
+  const char *mixed = "grep -v \"two words\" 'single $quoted' <in.txt | "
+                      "sort -k 2 | uniq -c >> out\\ file.txt &";
+  struct parse_ctx ctx = {mixed, strlen(mixed), {0}};
+  bench_report("parse", "mixed", "ns/op", bench_loop(parse_once, &ctx));
+}
+
+/* ─── Spawn and Pipelines ─── */
+
+static void spawn_fork_exec(void *arg) {
+  char *argv[] = {arg, NULL};
+  pid_t pid = fork();
+  if (pid == 0) {
+    execv(arg, argv);
+    _exit(127);
+  }
+  waitpid(pid, NULL, 0);
+}
+
+static void spawn_posix(void *arg) {
+  char *argv[] = {arg, NULL};
+  pid_t pid;
+  if (posix_spawn(&pid, arg, NULL, NULL, argv, environ) == 0)
+    waitpid(pid, NULL, 0);
+}
+
+static void run_shell_line(void *arg) {
+  char buf[4096];
+  struct command_t command;
+  memset(&command, 0, sizeof(command));
+  snprintf(buf, sizeof(buf), "%s", (const char *)arg);
+  if (parse_command(buf, &command) == 0)
+    process_command(&command);
+  free_command(&command);
+}
+
+/**
+ * Latency of starting and reaping one process: fork + execv against
+ * posix_spawn, and the shell's own path for a whole command line
+ */
+static void bench_spawn() {
+  char true_path[] = "/bin/true";
+  bench_report("spawn", "fork+execv", "us/op",
+               bench_loop(spawn_fork_exec, true_path) / 1e3);
+  bench_report("spawn", "posix_spawn", "us/op",
+               bench_loop(spawn_posix, true_path) / 1e3);
+#ifdef USE_FORK_EXEC
+  const char *shell_case = "shell(fork)";
+#else
+  const char *shell_case = "shell(spawn)";
+#endif
+  bench_report("spawn", shell_case, "us/op",
+               bench_loop(run_shell_line, "true") / 1e3);
+}
+
+/**
+ * Setup and teardown of N-stage pipelines of `true`
+ */
+static void bench_pipeline() {
+  static const int stages[] = {1, 2, 4, 8};
+  char line[256], cas[64];
+  for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++) {
+    size_t len = snprintf(line, sizeof(line), "true");
+    for (int i = 1; i < stages[s]; i++)
+      len += snprintf(line + len, sizeof(line) - len, " | true");
+    snprintf(cas, sizeof(cas), "stages=%d", stages[s]);
+    bench_report("pipeline", cas, "us/op",
+                 bench_loop(run_shell_line, line) / 1e3);
+  }
+}
+
+/* ─── cut ─── */
+
+/**
+ * Write a TSV file of about BENCH_CUT_BYTES with the given row width
+ * @param  path   file to create
+ * @param  fields fields per row
+ * @return        0, or -1 on error
+ */
+static int cut_generate(const char *path, int fields) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL)
+    return -1;
+  long written = 0;
+  for (long row = 0; written < BENCH_CUT_BYTES; row++) {
+    for (int i = 0; i < fields; i++)
+      written += fprintf(f, "%s%ld.%d", i ? "\t" : "", row, i);
+    fputc('\n', f);
+    written++;
+  }
+  fclose(f);
+  return 0;
+}
+
+/**
+ * handle_cut() throughput on a memory-mapped file for narrow and wide rows,
+ * single-threaded and with all CPUs; best of three runs
+ */
+static void bench_cut() {
+  static const int widths[] = {4, 16, 64};
+  static const char *jobs[] = {"1", "0"};
+  char path[64], cas[64];
+  snprintf(path, sizeof(path), "/tmp/shellish-bench-%d.tsv", (int)getpid());
+
+  for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+    if (cut_generate(path, widths[w]) < 0) {
+      perror(path);
+      return;
+    }
+    struct stat st;
+    stat(path, &st);
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+      double best = 0;
+      for (int run = 0; run < 3; run++) {
+        char *argv[] = {"cut", "-f", "2,3", "-j", (char *)jobs[j], NULL};
+        int saved_in = dup(STDIN_FILENO);
+        int fd = open(path, O_RDONLY);
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+        bench_quiet_begin();
+        double start = bench_now();
+        handle_cut(5, argv);
+        double elapsed = bench_now() - start;
+        bench_quiet_end();
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+        double gbps = st.st_size / elapsed / 1e9;
+        if (gbps > best)
+          best = gbps;
+      }
+      snprintf(cas, sizeof(cas), "fields=%d,jobs=%s", widths[w], jobs[j]);
+      bench_report("cut", cas, "GB/s", best);
+    }
+  }
+  unlink(path);
+}
+
+/* ─── process_tree ─── */
+
+static void snapshot_once(void *arg) {
+  (void)arg;
+  proc_snapshot_free(proc_snapshot_take(1));
+}
+
+static void tree_once(void *arg) {
+  (void)arg;
+  char *argv[] = {"process_tree", "--no-color", NULL};
+  handle_process_tree(2, argv);
+}
+
+/**
+ * /proc scan and full tree rendering with extra idle processes around
+ */
+static void bench_process_tree() {
+  static const int extra[] = {0, 100, 400};
+  pid_t *children = malloc(sizeof(pid_t) * extra[2]);
+  int started = 0;
+  char cas[64];
+
+  for (size_t e = 0; e < sizeof(extra) / sizeof(extra[0]); e++) {
+    for (; started < extra[e]; started++) {
+      pid_t pid = fork();
+      if (pid == 0) {
+        pause();
+        _exit(0);
+      }
+      if (pid < 0)
+        break;
+      children[started] = pid;
+    }
+    snprintf(cas, sizeof(cas), "extra=%d", started);
+    bench_report("proctree", cas, "us/snapshot",
+                 bench_loop(snapshot_once, NULL) / 1e3);
+    bench_quiet_begin();
+    double ns = bench_loop(tree_once, NULL);
+    bench_quiet_end();
+    bench_report("proctree", cas, "us/print", ns / 1e3);
+  }
+
+  for (int i = 0; i < started; i++)
+    kill(children[i], SIGKILL);
+  for (int i = 0; i < started; i++)
+    waitpid(children[i], NULL, 0);
+  free(children);
+}
+
+/* ─── chatroom ─── */
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Close and remove the simulated users' FIFOs and the room directory
+ * @param room_path room directory
+ * @param fds       read ends, released
+ * @param dummy     write ends, released
+ * @param users     simulated users
+ */
+static void chat_room_remove(const char *room_path, struct pollfd *fds,
+                             int *dummy, int users) {
+  char path[256];
+  for (int i = 0; i < users; i++) {
+    close(fds[i].fd);
+    close(dummy[i]);
+    snprintf(path, sizeof(path), "%s/user%d", room_path, i);
+    unlink(path);
+  }
+  rmdir(room_path);
+  free(fds);
+  free(dummy);
+}
+
+/**
+ * Fan-out latency of the FIFO transport: one real chatroom writer and N
+ * simulated users that are just FIFOs in the room held open by this
+ * process. Latency is measured from handing a line to the writer until
+ * every user's FIFO has the message. A message that does not reach every
+ * user within a second is counted as a timeout, not as a sample.
+ * @param users simulated users
+ */
+static void chat_fanout(int users) {
+  char room[64], room_path[128], path[256];
+  snprintf(room, sizeof(room), "bench-%d", (int)getpid());
+  snprintf(room_path, sizeof(room_path), "/tmp/chatroom-%s", room);
+  mkdir(room_path, 0777);
+
+  struct pollfd *fds = malloc(sizeof(*fds) * users);
+  int *dummy = malloc(sizeof(int) * users);
+  for (int i = 0; i < users; i++) {
+    snprintf(path, sizeof(path), "%s/user%d", room_path, i);
+    mkfifo(path, 0666);
+    fds[i].fd = open(path, O_RDONLY | O_NONBLOCK);
+    dummy[i] = open(path, O_WRONLY); // keeps the FIFO from reporting EOF
+    fds[i].events = POLLIN;
+  }
+
+  int in[2];
+  if (pipe(in) < 0) {
+    perror("bench: pipe");
+    chat_room_remove(room_path, fds, dummy, users);
+    return;
+  }
+  fflush(stdout);
+  pid_t writer = fork();
+  if (writer == 0) {
+    dup2(in[0], STDIN_FILENO);
+    close(in[0]);
+    close(in[1]);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO); // its exit statistics
+    char *argv[] = {"chatroom", room, "writer", NULL};
+    chatroom(3, argv);
+    _exit(0);
+  }
+  close(in[0]);
+  usleep(100 * 1000); // let the writer scan the room
+
+  double *lat = malloc(sizeof(double) * BENCH_CHAT_MESSAGES);
+  int samples = 0, timeouts = 0;
+  char buf[4096], line[64];
+  for (int m = 0; m < BENCH_CHAT_MESSAGES; m++) {
+    int len = snprintf(line, sizeof(line), "message %d\n", m);
+    double start = bench_now();
+    if (write(in[1], line, len) != len)
+      break;
+    int left = users; // every user must see it once
+    while (left > 0) {
+      if (poll(fds, users, 1000) <= 0)
+        break;
+      for (int i = 0; i < users; i++) {
+        if (!(fds[i].revents & POLLIN))
+          continue;
+        while (read(fds[i].fd, buf, sizeof(buf)) > 0)
+          ;
+        fds[i].events = 0; // done for this message
+        left--;
+      }
+    }
+    if (left > 0)
+      timeouts++;
+    else
+      lat[samples++] = (bench_now() - start) * 1e6;
+    for (int i = 0; i < users; i++)
+      fds[i].events = POLLIN;
+  }
+
+  close(in[1]); // EOF: the writer cleans up and exits
+  waitpid(writer, NULL, 0);
+  chat_room_remove(room_path, fds, dummy, users);
+
+  char cas[64];
+  if (samples > 0) {
+    qsort(lat, samples, sizeof(double), compare_double);
+    snprintf(cas, sizeof(cas), "users=%d,p50", users);
+    bench_report("chatroom", cas, "us", lat[samples / 2]);
+    snprintf(cas, sizeof(cas), "users=%d,p99", users);
+    bench_report("chatroom", cas, "us", lat[samples * 99 / 100]);
+  }
+  snprintf(cas, sizeof(cas), "users=%d,timeouts", users);
+  bench_report("chatroom", cas, "messages", timeouts);
+  free(lat);
+}
+
+static void bench_chatroom() {
+  static const int users[] = {1, 8, 32};
+  for (size_t u = 0; u < sizeof(users) / sizeof(users[0]); u++)
+    chat_fanout(users[u]);
+}
+
+/* ─── Main ─── */
+
+static const struct {
+  const char *name;
+  void (*fn)(void);
+} benchmarks[] = {
+    {"parse", bench_parse},
+    {"spawn", bench_spawn},
+    {"pipeline", bench_pipeline},
+    {"cut", bench_cut},
+    {"proctree", bench_process_tree},
+    {"chatroom", bench_chatroom},
+};
+
+int main(int argc, char *argv[]) {
+  if (argc > 1)
+    bench_filter = argv[1];
+  signal(SIGPIPE, SIG_IGN);
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    if (bench_selected(benchmarks[i].name))
+      benchmarks[i].fn();
+  return 0;
+}
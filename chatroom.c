@@ -7,34 +7,289 @@
  *   - The process forks into two roles:
  *       CHILD  (reader) — blocks on its own pipe, prints incoming messages.
  *       PARENT (writer) — reads user input from stdin and broadcasts it
- *                         to every *other* user's pipe in the room.
+ *                         to every *other* user's pipe in the room over
+ *                         persistent non-blocking descriptors.
+ *   - Rooms created with --shm use one shared-memory ring buffer instead
+ *     (see "Shared-Memory Transport"); the FIFOs then only mark presence.
  *
  * Signal handling:
  *   SIGINT / SIGTERM trigger cleanup(): the reader child is killed and
- *   the user's FIFO is removed so the room stays tidy.
+ *   the user's FIFO is removed so the room stays tidy. A --shm member
+ *   that dies without cleanup() is noticed by PID, so its segment does
+ *   not outlive the room.
  */
 
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 /* Return codes used throughout the module */
 int SUCCESS = 0;
 int FAILURE = 1;
 
+/* Bytes kept per recipient that is not draining its pipe; older queued
+ * messages are dropped beyond this so a stuck reader cannot grow us. */
+#define CHAT_PENDING_MAX (64 * 1024)
+
+/* Reader buffer: one wake-up drains up to this much per read() */
+#define CHAT_READ_BLOCK (64 * 1024)
+
+/* How long one broadcast may wait for full pipes before queueing */
+#define CHAT_SEND_WAIT_MS 100
+
+/*
+ * One other participant. fd is a cached O_WRONLY | O_NONBLOCK descriptor
+ * to their FIFO (-1 while they have no reader attached); pending holds
+ * whatever a full pipe refused, sent ahead of the next message.
+ */
+typedef struct {
+  char *name;
+  int fd;
+  char *pending;
+  size_t pending_len;
+  size_t pending_cap;
+  int seen; /* mark for chat_members_scan() */
+} chat_member_t;
+
+typedef struct {
+  chat_member_t *items;
+  int count;
+  int cap;
+  int watch_fd;          /* inotify on the room directory, or -1 */
+  struct timespec mtime; /* room directory mtime of the last scan */
+  int scanned;
+} chat_members_t;
+
+/* Called for every FIFO created (joined = 1) or removed (joined = 0) */
+typedef void (*chat_watch_fn)(void *ctx, const char *name, int joined);
+
+/* Size of the data area of a --shm room (power of two) */
+#define CHAT_RING_SIZE (1 << 20)
+
+#define CHAT_RING_MAGIC 0x43524e47u
+
+/* PIDs of the members of a --shm room that are recorded in its segment */
+#define CHAT_RING_MEMBERS 64
+
+/*
+ * Shared-memory room. Writers reserve space by a fetch-add on head and
+ * publish a record by storing its absolute position + 1 in the record's tag
+ * last; wake is a futex word bumped after every publish. Members record
+ * their PID in a free member slot: the last live one out unlinks the
+ * segment, and a segment whose recorded members all died is stale.
+ */
+typedef struct {
+  _Atomic uint32_t magic; /* CHAT_RING_MAGIC once initialized */
+  _Atomic uint32_t wake;  /* futex word */
+  _Atomic uint32_t waiters;
+  _Atomic uint64_t head;  /* bytes reserved so far (never wraps) */
+  _Atomic int32_t member[CHAT_RING_MEMBERS]; /* writer PIDs, 0 = free */
+  _Alignas(64) char data[CHAT_RING_SIZE];
+} chat_ring_t;
+
+/* Record header; records are padded to 16 bytes so headers never wrap */
+typedef struct {
+  _Atomic uint64_t tag; /* absolute position + 1 once committed */
+  uint32_t len;
+  int32_t sender; /* writer PID, so the sender's own reader skips it */
+} chat_rec_t;
+
+/*
+ * Wire format: every message travels as one frame, a fixed header
+ * followed by the sender's name and the text. Readers reassemble frames
+ * from the byte stream and only format "[room] name: text" for display.
+ */
+typedef struct {
+  uint32_t len;      /* payload bytes after the header (name + text) */
+  uint32_t sender;   /* sender id (writer PID) */
+  uint64_t sent_ns;  /* CLOCK_REALTIME when the line was read */
+  uint32_t seq;      /* per-sender sequence number */
+  uint16_t name_len; /* the payload starts with this many name bytes */
+  uint16_t magic;    /* CHAT_FRAME_MAGIC */
+} chat_frame_t;
+
+#define CHAT_FRAME_MAGIC 0xC4A7
+#define CHAT_NAME_MAX 255
+#define CHAT_TEXT_MAX 1023
+#define CHAT_FRAME_MAX                                                         \
+  (sizeof(chat_frame_t) + CHAT_NAME_MAX + CHAT_TEXT_MAX)
+
+/* Log2 histogram of durations: bucket i counts values below 2^i us */
+#define CHAT_HIST_BUCKETS 32
+typedef struct {
+  uint64_t count;
+  uint64_t sum_us;
+  uint64_t max_us;
+  uint64_t bucket[CHAT_HIST_BUCKETS];
+} chat_hist_t;
+
+/*
+ * Session counters. They live in a shared anonymous mapping created
+ * before the fork, so the writer can report what its reader measured;
+ * each field is only updated by one of the two processes.
+ */
+typedef struct {
+  struct timespec start; /* CLOCK_MONOTONIC at join */
+  /* writer */
+  uint64_t sent_msgs;
+  uint64_t sent_bytes;
+  uint64_t delivered;   /* frames written to a recipient pipe */
+  uint64_t skipped;     /* frames for recipients with no reader (ENXIO) */
+  uint64_t dropped;     /* frames discarded from a full backlog */
+  chat_hist_t fanout;   /* time to hand one message to every recipient */
+  /* reader */
+  uint64_t recv_msgs;
+  uint64_t recv_bytes;
+  uint64_t lost;        /* ring records overwritten before being read */
+  chat_hist_t latency;  /* sender's fgets() to our terminal write */
+} chat_stats_t;
+
 /*
  * Global state shared with the signal handler so it can clean up
  * regardless of where the signal is caught.
  */
 static char user_pipe[512];   /* Absolute path to this user's FIFO */
 static pid_t reader_pid = -1; /* PID of the reader child process   */
+static chat_ring_t *room_ring;  /* --shm room, or NULL for FIFOs    */
+static char ring_name[256];     /* shm_open() name of room_ring     */
+static chat_stats_t *stats;     /* shared with the reader child     */
+
+static int chat_ring_leave(chat_ring_t *ring);
+
+/* ─── Statistics ─── */
+
+static uint64_t chat_now_us(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void chat_hist_add(chat_hist_t *h, uint64_t us) {
+  int b = 0;
+  while (b < CHAT_HIST_BUCKETS - 1 && us >= (1ull << b))
+    b++;
+  h->bucket[b]++;
+  h->count++;
+  h->sum_us += us;
+  if (us > h->max_us)
+    h->max_us = us;
+}
+
+/* Upper bound of the bucket holding the given quantile */
+static uint64_t chat_hist_quantile(const chat_hist_t *h, double q) {
+  uint64_t want = (uint64_t)(q * (double)h->count + 0.5), seen = 0;
+  for (int b = 0; b < CHAT_HIST_BUCKETS; b++) {
+    seen += h->bucket[b];
+    if (seen >= want && seen > 0)
+      return (1ull << b) < h->max_us ? 1ull << b : h->max_us;
+  }
+  return h->max_us;
+}
+
+/*
+ * Text of the statistics report. It is formatted into this buffer and
+ * written with one write(), since cleanup() prints it from a signal
+ * handler, where stdio must not be used.
+ */
+typedef struct {
+  char data[2048];
+  size_t len;
+} chat_report_t;
+
+static void chat_report_add(chat_report_t *r, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(r->data + r->len, sizeof(r->data) - r->len, fmt, ap);
+  va_end(ap);
+  if (n > 0)
+    r->len += (size_t)n < sizeof(r->data) - r->len
+                  ? (size_t)n
+                  : sizeof(r->data) - 1 - r->len;
+}
+
+static void chat_hist_print(chat_report_t *r, const char *label,
+                            const chat_hist_t *h) {
+  if (h->count == 0) {
+    chat_report_add(r, "%-10s n=0\n", label);
+    return;
+  }
+  chat_report_add(r,
+                  "%-10s n=%llu avg=%lluus p50<=%lluus p99<=%lluus "
+                  "max=%lluus\n",
+                  label, (unsigned long long)h->count,
+                  (unsigned long long)(h->sum_us / h->count),
+                  (unsigned long long)chat_hist_quantile(h, 0.50),
+                  (unsigned long long)chat_hist_quantile(h, 0.99),
+                  (unsigned long long)h->max_us);
+}
+
+/**
+ * chat_stats_print — writes the session counters (/stats and on exit).
+ *
+ * @param fd  Destination descriptor.
+ */
+static void chat_stats_print(int fd) {
+  chat_report_t r = {.len = 0};
+  double secs = (double)(chat_now_us(CLOCK_MONOTONIC) -
+                         ((uint64_t)stats->start.tv_sec * 1000000 +
+                          stats->start.tv_nsec / 1000)) /
+                1e6;
+  if (secs <= 0)
+    secs = 1e-6;
+  chat_report_add(&r, "--- chatroom stats (%.1fs, %s) ---\n", secs,
+                  room_ring != NULL ? "shm" : "fifo");
+  chat_report_add(&r,
+                  "%-10s %llu msgs, %llu bytes (%.1f msg/s, %.1f KB/s)\n",
+                  "sent", (unsigned long long)stats->sent_msgs,
+                  (unsigned long long)stats->sent_bytes,
+                  stats->sent_msgs / secs, stats->sent_bytes / secs / 1024);
+  if (room_ring == NULL)
+    chat_report_add(&r,
+                    "%-10s %llu frames, %llu skipped (no reader), %llu "
+                    "dropped (backlog full)\n",
+                    "delivered", (unsigned long long)stats->delivered,
+                    (unsigned long long)stats->skipped,
+                    (unsigned long long)stats->dropped);
+  chat_hist_print(&r, "fan-out", &stats->fanout);
+  chat_report_add(&r,
+                  "%-10s %llu msgs, %llu bytes (%.1f msg/s, %.1f KB/s)\n",
+                  "received", (unsigned long long)stats->recv_msgs,
+                  (unsigned long long)stats->recv_bytes,
+                  stats->recv_msgs / secs, stats->recv_bytes / secs / 1024);
+  chat_hist_print(&r, "latency", &stats->latency);
+  if (room_ring != NULL)
+    chat_report_add(&r, "%-10s %llu (ring overrun)\n", "lost",
+                    (unsigned long long)stats->lost);
+
+  for (size_t off = 0; off < r.len;) {
+    ssize_t n = write(fd, r.data + off, r.len - off);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    off += n;
+  }
+}
 
 /**
  * cleanup — signal handler for SIGINT and SIGTERM.
@@ -42,7 +297,11 @@ static pid_t reader_pid = -1; /* PID of the reader child process   */
  * Ensures graceful shutdown:
  *   1. Terminates the reader child process (if still alive).
  *   2. Removes the user's named pipe from the room directory.
- *   3. Exits the program.
+ *   3. Prints the session statistics (writer only).
+ *   4. Exits the program.
+ *
+ * Everything here has to be safe in a signal handler: no stdio, and
+ * _exit() instead of exit().
  *
  * @param sig  The signal number (unused, cast to void).
  */
@@ -55,13 +314,812 @@ void cleanup(int sig) {
 
   /* Remove the user's named pipe so the room directory stays clean */
   unlink(user_pipe);
-  exit(0);
+
+  /* Last live member of a --shm room removes the segment */
+  if (room_ring != NULL && chat_ring_leave(room_ring) == 0)
+    shm_unlink(ring_name);
+
+  /* The writer reports the session (the reader is killed with SIGTERM) */
+  if (reader_pid > 0 && stats != NULL) {
+    waitpid(reader_pid, NULL, 0); /* its last counters are in place */
+    if (write(STDERR_FILENO, "\n", 1) == 1)
+      chat_stats_print(STDERR_FILENO);
+  }
+  _exit(0);
+}
+
+/* ─── Wire Format ─── */
+
+/**
+ * chat_frame_build — encodes one message.
+ *
+ * @param out   Buffer of at least CHAT_FRAME_MAX bytes.
+ * @param name  Sender name (truncated to CHAT_NAME_MAX).
+ * @param text  Message text (truncated to CHAT_TEXT_MAX).
+ * @param seq   Sender's sequence number.
+ * @return      Frame size in bytes.
+ */
+static size_t chat_frame_build(char *out, const char *name, const char *text,
+                               uint32_t seq) {
+  size_t name_len = strlen(name), text_len = strlen(text);
+  if (name_len > CHAT_NAME_MAX)
+    name_len = CHAT_NAME_MAX;
+  if (text_len > CHAT_TEXT_MAX)
+    text_len = CHAT_TEXT_MAX;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  chat_frame_t h = {(uint32_t)(name_len + text_len), (uint32_t)getpid(),
+                    (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec, seq,
+                    (uint16_t)name_len, CHAT_FRAME_MAGIC};
+  memcpy(out, &h, sizeof(h));
+  memcpy(out + sizeof(h), name, name_len);
+  memcpy(out + sizeof(h) + name_len, text, text_len);
+  return sizeof(h) + h.len;
+}
+
+/**
+ * chat_frame_next — decodes the frame at the start of a byte stream.
+ *
+ * @param p    Stream bytes.
+ * @param len  Number of bytes available.
+ * @param h    Decoded header.
+ * @return     Frame size if a whole frame is available, 0 if more bytes
+ *             are needed, -1 if the stream is not at a valid frame.
+ */
+static ssize_t chat_frame_next(const char *p, size_t len, chat_frame_t *h) {
+  if (len < sizeof(*h))
+    return 0;
+  memcpy(h, p, sizeof(*h)); /* headers need not be aligned in the stream */
+  if (h->magic != CHAT_FRAME_MAGIC || h->name_len > h->len ||
+      h->len > CHAT_FRAME_MAX - sizeof(*h))
+    return -1;
+  if (len < sizeof(*h) + h->len)
+    return 0;
+  return sizeof(*h) + h->len;
+}
+
+/* Number of whole frames in a queued byte stream */
+static uint64_t chat_frame_count(const char *p, size_t len) {
+  uint64_t count = 0;
+  chat_frame_t h;
+  ssize_t n;
+  for (size_t off = 0; (n = chat_frame_next(p + off, len - off, &h)) > 0;
+       off += n)
+    count++;
+  return count;
+}
+
+/* ─── Shared-Memory Transport ─── */
+
+/**
+ * chat_ring_live — counts the recorded members that are still running and
+ * frees the slots of those that died without leaving.
+ *
+ * @param ring  Room ring.
+ * @return      Number of live members.
+ */
+static int chat_ring_live(chat_ring_t *ring) {
+  int live = 0;
+  for (int i = 0; i < CHAT_RING_MEMBERS; i++) {
+    int32_t pid = atomic_load(&ring->member[i]);
+    if (pid <= 0)
+      continue;
+    if (kill(pid, 0) == 0 || errno == EPERM)
+      live++;
+    else
+      atomic_compare_exchange_strong(&ring->member[i], &pid, 0);
+  }
+  return live;
+}
+
+/* Records this process in a free member slot (none left: unrecorded) */
+static void chat_ring_join(chat_ring_t *ring) {
+  int32_t self = (int32_t)getpid();
+  for (int i = 0; i < CHAT_RING_MEMBERS; i++) {
+    int32_t free_slot = 0;
+    if (atomic_compare_exchange_strong(&ring->member[i], &free_slot, self))
+      return;
+  }
+}
+
+/**
+ * chat_ring_leave — removes this process from the member slots. Only
+ * async-signal-safe calls, since cleanup() runs it.
+ *
+ * @param ring  Room ring.
+ * @return      Number of members still alive.
+ */
+static int chat_ring_leave(chat_ring_t *ring) {
+  int32_t self = (int32_t)getpid();
+  for (int i = 0; i < CHAT_RING_MEMBERS; i++) {
+    int32_t pid = self;
+    atomic_compare_exchange_strong(&ring->member[i], &pid, 0);
+  }
+  return chat_ring_live(ring);
+}
+
+/**
+ * chat_ring_map — opens or creates the segment named ring_name and joins it.
+ *
+ * @param create  Create the segment if there is none.
+ * @param stale   Set to 1 if the segment exists but all of its recorded
+ *                members are gone (NULL is returned then).
+ * @return        Mapped ring, or NULL if there is no segment (and create
+ *                is 0) or it could not be set up.
+ */
+static chat_ring_t *chat_ring_map(int create, int *stale) {
+  *stale = 0;
+  /* A joiner never creates: a probe with O_CREAT could remove a segment
+   * that a concurrent --shm creator is about to use */
+  int fd = shm_open(ring_name, O_RDWR | (create ? O_CREAT | O_EXCL : 0),
+                    0666);
+  int fresh = create && fd >= 0;
+  if (fd < 0 && create && errno == EEXIST)
+    fd = shm_open(ring_name, O_RDWR, 0);
+  if (fd < 0) /* ENOENT without create: the room uses FIFOs */
+    return NULL;
+  if (fresh && ftruncate(fd, sizeof(chat_ring_t)) < 0) {
+    close(fd);
+    shm_unlink(ring_name);
+    return NULL;
+  }
+
+  /* A joiner may race the creator's ftruncate(); wait for the size */
+  struct stat st;
+  for (int i = 0; !fresh && i < 100; i++) {
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(chat_ring_t))
+      break;
+    usleep(1000);
+  }
+  if (!fresh && (fstat(fd, &st) < 0 ||
+                 st.st_size < (off_t)sizeof(chat_ring_t))) {
+    close(fd);
+    return NULL;
+  }
+
+  chat_ring_t *ring = mmap(NULL, sizeof(chat_ring_t), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+  close(fd);
+  if (ring == MAP_FAILED)
+    return NULL;
+
+  if (fresh) { /* the new segment is zero-filled; only the magic is left */
+    chat_ring_join(ring); /* before the magic, so joiners see a member */
+    atomic_store_explicit(&ring->magic, CHAT_RING_MAGIC, memory_order_release);
+    return ring;
+  }
+  for (int i = 0; i < 100 && atomic_load_explicit(&ring->magic,
+                                                 memory_order_acquire) !=
+                                 CHAT_RING_MAGIC;
+       i++)
+    usleep(1000);
+  if (atomic_load(&ring->magic) != CHAT_RING_MAGIC) {
+    munmap(ring, sizeof(chat_ring_t));
+    return NULL;
+  }
+  if (chat_ring_live(ring) == 0) {
+    munmap(ring, sizeof(chat_ring_t));
+    *stale = 1;
+    return NULL;
+  }
+  chat_ring_join(ring);
+  return ring;
+}
+
+/**
+ * chat_ring_open — maps the room's ring buffer. A segment left behind by
+ * members that all died is removed; with create a fresh one replaces it.
+ *
+ * @param roomname  Room name.
+ * @param create    Create the segment if the room has none yet.
+ * @return          Mapped ring, or NULL if the room has no segment (and
+ *                  create is 0) or it could not be set up.
+ */
+static chat_ring_t *chat_ring_open(const char *roomname, int create) {
+  snprintf(ring_name, sizeof(ring_name), "/chatroom-%s", roomname);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    int stale;
+    chat_ring_t *ring = chat_ring_map(create, &stale);
+    if (!stale)
+      return ring;
+    shm_unlink(ring_name); /* nobody recorded in it is alive any more */
+    if (!create)
+      return NULL;
+  }
+  return NULL;
+}
+
+/* Copies between the ring and a flat buffer, wrapping at the end */
+static void chat_ring_copy(char *dst, const char *src, uint64_t pos,
+                           size_t len, int to_ring) {
+  size_t off = pos & (CHAT_RING_SIZE - 1);
+  size_t first = len < CHAT_RING_SIZE - off ? len : CHAT_RING_SIZE - off;
+  if (to_ring) {
+    memcpy(dst + off, src, first);
+    memcpy(dst, src + first, len - first);
+  } else {
+    memcpy(dst, src + off, first);
+    memcpy(dst + first, src, len - first);
+  }
+}
+
+/**
+ * chat_ring_send — appends one message for every reader of the room.
+ * The whole broadcast is a single copy into shared memory plus, when some
+ * reader is asleep, one futex wake. Termination signals are held off
+ * between reserving the record and publishing it: a slot reserved but
+ * never published would stall every reader until the ring laps it.
+ *
+ * @param ring  Room ring.
+ * @param msg   Message bytes.
+ * @param len   Number of bytes (well below CHAT_RING_SIZE).
+ */
+static void chat_ring_send(chat_ring_t *ring, const char *msg, size_t len) {
+  sigset_t term, saved;
+  sigemptyset(&term);
+  sigaddset(&term, SIGINT);
+  sigaddset(&term, SIGTERM);
+  sigaddset(&term, SIGHUP);
+  sigaddset(&term, SIGQUIT);
+  sigprocmask(SIG_BLOCK, &term, &saved);
+
+  uint64_t rec_len = (sizeof(chat_rec_t) + len + 15) & ~(uint64_t)15;
+  uint64_t pos = atomic_fetch_add(&ring->head, rec_len);
+
+  chat_rec_t *rec = (chat_rec_t *)(ring->data + (pos & (CHAT_RING_SIZE - 1)));
+  rec->len = (uint32_t)len;
+  rec->sender = getpid();
+  chat_ring_copy(ring->data, msg, pos + sizeof(chat_rec_t), len, 1);
+  /* publish */
+  atomic_store_explicit(&rec->tag, pos + 1, memory_order_release);
+  sigprocmask(SIG_SETMASK, &saved, NULL);
+
+  atomic_fetch_add(&ring->wake, 1);
+  if (atomic_load(&ring->waiters) > 0) {
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)&ring->wake, FUTEX_WAKE, INT32_MAX, NULL,
+            NULL, 0);
+#endif
+  }
+}
+
+/**
+ * chat_ring_recv — reads the next message after *cursor, waiting up to
+ * timeout_ms for one to be published. A reader that fell a whole ring
+ * behind skips ahead to the oldest data still intact.
+ *
+ * @param ring        Room ring.
+ * @param cursor      This reader's position, advanced past the record.
+ * @param buf         Output buffer.
+ * @param cap         Size of buf.
+ * @param sender      Set to the writer PID of the record.
+ * @param timeout_ms  How long to wait (0: do not wait).
+ * @return            Message length, 0 on timeout or skipped record.
+ */
+static size_t chat_ring_recv(chat_ring_t *ring, uint64_t *cursor, char *buf,
+                             size_t cap, int *sender, int timeout_ms) {
+  uint64_t pos = *cursor;
+  /* Sample the futex word first: a publish after this point changes it,
+   * so the wait below cannot sleep through that message */
+  uint32_t seen = atomic_load(&ring->wake);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (head - pos > CHAT_RING_SIZE) { /* overrun: data was overwritten */
+    *cursor = head;
+    stats->lost++;
+    return 0;
+  }
+
+  /* Positions never repeat, so only a published record carries tag pos + 1
+   * (+ 1 so the zero-filled fresh segment holds no valid tag) */
+  chat_rec_t *rec = (chat_rec_t *)(ring->data + (pos & (CHAT_RING_SIZE - 1)));
+  if (atomic_load_explicit(&rec->tag, memory_order_acquire) != pos + 1) {
+    /* Nothing published at the cursor yet: sleep on the futex word */
+    if (timeout_ms == 0)
+      return 0;
+    atomic_fetch_add(&ring->waiters, 1);
+#ifdef __linux__
+    struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, (uint32_t *)&ring->wake, FUTEX_WAIT, seen, &ts, NULL,
+            0);
+#else
+    usleep(timeout_ms < 10 ? timeout_ms * 1000 : 10000);
+#endif
+    atomic_fetch_sub(&ring->waiters, 1);
+    return 0;
+  }
+
+  uint32_t len = rec->len;
+  *sender = rec->sender;
+  uint64_t rec_len = (sizeof(chat_rec_t) + len + 15) & ~(uint64_t)15;
+  size_t n = len < cap ? len : cap;
+  chat_ring_copy(buf, ring->data, pos + sizeof(chat_rec_t), n, 0);
+  *cursor = pos + rec_len;
+
+  /* A writer lapping us while we copied may have torn the record */
+  if (atomic_load_explicit(&ring->head, memory_order_acquire) - pos >
+      CHAT_RING_SIZE) {
+    stats->lost++;
+    return 0;
+  }
+  return n;
+}
+
+/* ─── Room Watching ─── */
+
+/**
+ * chat_watch_open — starts watching the room directory for FIFOs being
+ * created or removed.
+ *
+ * @param room_path  Room directory.
+ * @return           Non-blocking watch descriptor, or -1 where inotify is
+ *                   unavailable (callers then fall back to rescanning).
+ */
+static int chat_watch_open(const char *room_path) {
+#ifdef __linux__
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (inotify_add_watch(fd, room_path,
+                        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_ONLYDIR) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+#else
+  (void)room_path;
+  return -1;
+#endif
+}
+
+/**
+ * chat_watch_drain — reports every pending room event without blocking.
+ *
+ * @param fd   Descriptor from chat_watch_open().
+ * @param fn   Callback per created / removed name.
+ * @param ctx  Passed to fn.
+ * @return     0 on success, -1 if events were lost (queue overflow) and
+ *             the caller must rescan the directory.
+ */
+static int chat_watch_drain(int fd, chat_watch_fn fn, void *ctx) {
+#ifdef __linux__
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int lost = 0;
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      if (ev->mask & IN_Q_OVERFLOW)
+        lost = 1;
+      else if (ev->len > 0)
+        fn(ctx, ev->name, (ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0);
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+  return lost ? -1 : 0;
+#else
+  (void)fd;
+  (void)fn;
+  (void)ctx;
+  return 0;
+#endif
+}
+
+/* What the reader needs to announce joins and leaves */
+typedef struct {
+  const char *roomname;
+  const char *username;
+} chat_notice_t;
+
+/* chat_watch_fn printing a join / leave notice in the reader */
+static void chat_notify(void *ctx, const char *name, int joined) {
+  chat_notice_t *n = ctx;
+  if (strcmp(name, n->username) == 0) {
+    if (!joined)
+      exit(0); /* our own FIFO is gone */
+    return;
+  }
+  printf("\r\033[K*** %s %s the room\n", name, joined ? "joined" : "left");
+  printf("[%s] %s > ", n->roomname, n->username);
+  fflush(stdout);
+}
+
+/*
+ * Messages received in one wake-up; shown with a single write() so a
+ * burst costs one terminal update instead of one per message.
+ */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+  uint64_t *sent_us; /* send time of every message in the batch */
+  int count;
+  int count_cap;
+} chat_batch_t;
+
+static void chat_batch_add_raw(chat_batch_t *b, const char *p, size_t len) {
+  if (b->len + len > b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 4096;
+    while (b->len + len > b->cap)
+      b->cap *= 2;
+    b->data = realloc(b->data, b->cap);
+  }
+  memcpy(b->data + b->len, p, len);
+  b->len += len;
+}
+
+/* Appends received messages, clearing the prompt line first */
+static void chat_batch_add(chat_batch_t *b, const char *text, size_t len) {
+  if (len == 0)
+    return;
+  if (b->len == 0) /* start with: clear the prompt line */
+    chat_batch_add_raw(b, "\r\033[K", 4);
+  chat_batch_add_raw(b, text, len);
+}
+
+/**
+ * chat_batch_frames — formats every whole frame at the start of a byte
+ * stream for display.
+ *
+ * @param b       Batch.
+ * @param notice  Room name for the "[room] name: text" line.
+ * @param p       Stream bytes.
+ * @param len     Number of bytes available.
+ * @return        Bytes consumed; a trailing partial frame is left over.
+ *                A corrupt stream is consumed entirely.
+ */
+static size_t chat_batch_frames(chat_batch_t *b, const chat_notice_t *notice,
+                                const char *p, size_t len) {
+  size_t off = 0;
+  chat_frame_t h;
+  ssize_t n;
+  while ((n = chat_frame_next(p + off, len - off, &h)) > 0) {
+    const char *name = p + off + sizeof(h);
+    char line[CHAT_FRAME_MAX + 300];
+    int k = snprintf(line, sizeof(line), "[%s] %.*s: %.*s\n", notice->roomname,
+                     (int)h.name_len, name, (int)(h.len - h.name_len),
+                     name + h.name_len);
+    chat_batch_add(b, line, k < (int)sizeof(line) ? (size_t)k
+                                                  : sizeof(line) - 1);
+    if (b->count == b->count_cap) {
+      b->count_cap = b->count_cap ? b->count_cap * 2 : 64;
+      b->sent_us = realloc(b->sent_us, sizeof(uint64_t) * b->count_cap);
+    }
+    b->sent_us[b->count++] = h.sent_ns / 1000;
+    stats->recv_bytes += n;
+    off += n;
+  }
+  return n < 0 ? len : off;
+}
+
+/**
+ * chat_batch_flush — shows the batched messages followed by the prompt,
+ * in one write().
+ *
+ * @param b       Batch (emptied).
+ * @param notice  Room and user names for the prompt.
+ */
+static void chat_batch_flush(chat_batch_t *b, const chat_notice_t *notice) {
+  if (b->len == 0)
+    return;
+  char prompt[600];
+  int n = snprintf(prompt, sizeof(prompt), "[%s] %s > ", notice->roomname,
+                   notice->username);
+  chat_batch_add_raw(b, prompt, n < (int)sizeof(prompt) ? (size_t)n
+                                                        : sizeof(prompt) - 1);
+
+  fflush(stdout);
+  for (size_t off = 0; off < b->len;) {
+    ssize_t w = write(STDOUT_FILENO, b->data + off, b->len - off);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      break;
+    off += w;
+  }
+  b->len = 0;
+
+  /* Latency ends once the batch reached the terminal */
+  uint64_t now = chat_now_us(CLOCK_REALTIME);
+  for (int i = 0; i < b->count; i++)
+    chat_hist_add(&stats->latency, now > b->sent_us[i] ? now - b->sent_us[i]
+                                                          : 0);
+  stats->recv_msgs += b->count;
+  b->count = 0;
+}
+
+/* ─── Member Table ─── */
+
+static void chat_member_close(chat_member_t *m) {
+  if (m->fd >= 0)
+    close(m->fd);
+  free(m->name);
+  free(m->pending);
+}
+
+static int chat_members_find(const chat_members_t *set, const char *name) {
+  for (int i = 0; i < set->count; i++)
+    if (strcmp(set->items[i].name, name) == 0)
+      return i;
+  return -1;
+}
+
+static chat_member_t *chat_members_add(chat_members_t *set, const char *name) {
+  if (set->count == set->cap) {
+    set->cap = set->cap ? set->cap * 2 : 16;
+    set->items = realloc(set->items, sizeof(chat_member_t) * set->cap);
+  }
+  chat_member_t *m = &set->items[set->count++];
+  memset(m, 0, sizeof(*m));
+  m->name = strdup(name);
+  m->fd = -1;
+  return m;
+}
+
+static void chat_members_remove(chat_members_t *set, int i) {
+  chat_member_close(&set->items[i]);
+  set->items[i] = set->items[--set->count]; /* swap-remove */
+}
+
+/* chat_watch_fn applying one room event to the member table */
+static void chat_members_event(void *ctx, const char *name, int joined) {
+  chat_members_t *set = ctx;
+  int i = chat_members_find(set, name);
+  if (joined && i < 0)
+    chat_members_add(set, name);
+  else if (!joined && i >= 0)
+    chat_members_remove(set, i);
+}
+
+/**
+ * chat_members_scan — rebuilds the member table from the room directory.
+ * New members are appended with no descriptor yet; members whose FIFO is
+ * gone are closed and dropped. Descriptors of everyone else stay open.
+ *
+ * @param set        Member table.
+ * @param room_path  Room directory.
+ * @param self       Our own username (never a recipient).
+ * @return           0 on success, -1 if the directory cannot be read.
+ */
+static int chat_members_scan(chat_members_t *set, const char *room_path,
+                             const char *self) {
+  DIR *dir = opendir(room_path);
+  if (dir == NULL)
+    return -1;
+
+  for (int i = 0; i < set->count; i++)
+    set->items[i].seen = 0;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    /* Skip '.', '..' and ourselves */
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+        strcmp(entry->d_name, self) == 0)
+      continue;
+
+    int i = chat_members_find(set, entry->d_name);
+    chat_member_t *m = i >= 0 ? &set->items[i]
+                              : chat_members_add(set, entry->d_name);
+    m->seen = 1;
+  }
+  closedir(dir);
+
+  for (int i = 0; i < set->count;) {
+    if (set->items[i].seen)
+      i++;
+    else
+      chat_members_remove(set, i);
+  }
+  set->scanned = 1;
+  return 0;
+}
+
+/**
+ * chat_members_refresh — brings the member table up to date before a
+ * broadcast. With inotify this only applies the queued create / delete
+ * events, so no directory is read at all; the directory is scanned once at
+ * start and again only if the event queue overflowed. Without inotify the
+ * directory is rescanned when its mtime changed.
+ *
+ * @param set        Member table.
+ * @param room_path  Room directory.
+ * @param self       Our own username (never a recipient).
+ * @return           0 on success, -1 if the directory cannot be read.
+ */
+static int chat_members_refresh(chat_members_t *set, const char *room_path,
+                                const char *self) {
+  if (set->watch_fd >= 0) {
+    if (chat_watch_drain(set->watch_fd, chat_members_event, set) < 0 ||
+        !set->scanned)
+      return chat_members_scan(set, room_path, self);
+    return 0;
+  }
+
+  struct stat st;
+  if (stat(room_path, &st) < 0)
+    return -1;
+  if (set->scanned && st.st_mtim.tv_sec == set->mtime.tv_sec &&
+      st.st_mtim.tv_nsec == set->mtime.tv_nsec)
+    return 0;
+  set->mtime = st.st_mtim;
+  return chat_members_scan(set, room_path, self);
+}
+
+/**
+ * chat_member_queue — keeps bytes a full pipe refused. Whole messages are
+ * queued, so if the limit is hit the backlog is discarded instead of
+ * cutting a message in half.
+ *
+ * @param m    Recipient.
+ * @param buf  Message bytes.
+ * @param len  Number of bytes.
+ */
+static void chat_member_queue(chat_member_t *m, const char *buf, size_t len) {
+  if (m->pending_len + len > CHAT_PENDING_MAX) {
+    /* recipient is not reading; drop its backlog */
+    stats->dropped += chat_frame_count(m->pending, m->pending_len);
+    m->pending_len = 0;
+  }
+  if (len > CHAT_PENDING_MAX)
+    return;
+  if (m->pending_len + len > m->pending_cap) {
+    m->pending_cap = m->pending_cap ? m->pending_cap * 2 : 4096;
+    while (m->pending_len + len > m->pending_cap)
+      m->pending_cap *= 2;
+    m->pending = realloc(m->pending, m->pending_cap);
+  }
+  memcpy(m->pending + m->pending_len, buf, len);
+  m->pending_len += len;
+}
+
+/**
+ * chat_member_flush — writes queued bytes without blocking.
+ *
+ * @param m          Recipient.
+ * @param room_path  Room directory (to open the FIFO on demand).
+ * @return           1 if bytes are still queued, 0 otherwise.
+ */
+static int chat_member_flush(chat_member_t *m, const char *room_path) {
+  for (int attempt = 0; m->pending_len > 0 && attempt < 2; attempt++) {
+    if (m->fd < 0) {
+      char target_pipe[1024];
+      snprintf(target_pipe, sizeof(target_pipe), "%s/%s", room_path, m->name);
+      /* O_NONBLOCK: fails with ENXIO right away if nobody is reading */
+      m->fd = open(target_pipe, O_WRONLY | O_NONBLOCK);
+      if (m->fd < 0) {
+        /* not connected — skip silently, but count it */
+        stats->skipped += chat_frame_count(m->pending, m->pending_len);
+        m->pending_len = 0;
+        return 0;
+      }
+    }
+
+    /* Pack as many queued frames as fit in PIPE_BUF into one write:
+     * such writes are atomic, so frames from several senders never
+     * interleave and a full pipe refuses the write as a whole. */
+    size_t chunk = 0;
+    chat_frame_t h;
+    ssize_t f;
+    while ((f = chat_frame_next(m->pending + chunk, m->pending_len - chunk,
+                                &h)) > 0 &&
+           chunk + f <= PIPE_BUF)
+      chunk += f;
+    if (chunk == 0)
+      chunk = m->pending_len; /* cannot happen: frames fit in PIPE_BUF */
+
+    ssize_t n = write(m->fd, m->pending, chunk);
+    if (n > 0) {
+      stats->delivered += chat_frame_count(m->pending, n);
+      memmove(m->pending, m->pending + n, m->pending_len - n);
+      m->pending_len -= n;
+      attempt = -1; /* progress: keep going */
+    } else if (n < 0 && errno == EAGAIN) {
+      return 1; /* pipe full */
+    } else if (n < 0 && errno != EINTR) {
+      /* EPIPE: the reader went away, reopen once in case it came back */
+      close(m->fd);
+      m->fd = -1;
+    }
+  }
+  if (m->fd < 0) {
+    stats->skipped += chat_frame_count(m->pending, m->pending_len);
+    m->pending_len = 0;
+  }
+  return m->pending_len > 0;
+}
+
+/**
+ * chat_broadcast — sends one message to every member. Each recipient gets
+ * a non-blocking write on its cached descriptor; recipients with full
+ * pipes are then polled for POLLOUT for up to CHAT_SEND_WAIT_MS, and
+ * anything still undelivered stays queued for the next broadcast.
+ *
+ * @param set        Member table.
+ * @param room_path  Room directory.
+ * @param msg        Message bytes.
+ * @param len        Number of bytes.
+ */
+static void chat_broadcast(chat_members_t *set, const char *room_path,
+                           const char *msg, size_t len) {
+  struct pollfd *pfd = malloc(sizeof(struct pollfd) * (set->count + 1));
+  int *who = malloc(sizeof(int) * (set->count + 1));
+
+  int waiting = 0;
+  for (int i = 0; i < set->count; i++) {
+    chat_member_queue(&set->items[i], msg, len);
+    waiting += chat_member_flush(&set->items[i], room_path);
+  }
+
+  int budget = CHAT_SEND_WAIT_MS;
+  while (waiting > 0 && budget > 0) {
+    int n = 0;
+    for (int i = 0; i < set->count; i++) {
+      if (set->items[i].pending_len == 0 || set->items[i].fd < 0)
+        continue;
+      pfd[n].fd = set->items[i].fd;
+      pfd[n].events = POLLOUT;
+      who[n++] = i;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int ready = poll(pfd, n, budget);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    budget -= (int)((t1.tv_sec - t0.tv_sec) * 1000 +
+                    (t1.tv_nsec - t0.tv_nsec) / 1000000);
+    if (ready <= 0 && !(ready < 0 && errno == EINTR))
+      break;
+
+    waiting = 0;
+    for (int k = 0; k < n; k++) {
+      if (pfd[k].revents != 0)
+        chat_member_flush(&set->items[who[k]], room_path);
+      if (set->items[who[k]].pending_len > 0)
+        waiting++;
+    }
+  }
+
+  free(pfd);
+  free(who);
+}
+
+/**
+ * chat_ring_reader — reader role for a --shm room: prints every message
+ * other participants append to the ring. Room events are checked between
+ * waits, so the futex sleep is bounded to keep join / leave notices
+ * timely.
+ *
+ * @param ring      Room ring.
+ * @param notice    Room and user names for the prompt.
+ * @param watch_fd  Room directory watch, or -1.
+ */
+static void chat_ring_reader(chat_ring_t *ring, chat_notice_t *notice,
+                             int watch_fd) {
+  pid_t self = getppid(); /* the writer half of this participant */
+  uint64_t cursor = atomic_load(&ring->head);
+  char buf[4096];
+  chat_batch_t batch = {NULL, 0, 0, NULL, 0, 0};
+
+  while (1) {
+    int sender;
+    /* Only block when there is nothing left to show */
+    size_t n = chat_ring_recv(ring, &cursor, buf, sizeof(buf), &sender,
+                              batch.len > 0 ? 0 : 250);
+    if (n > 0 && sender != self)
+      chat_batch_frames(&batch, notice, buf, n);
+    if (n > 0)
+      continue; /* keep collecting while records are queued */
+    chat_batch_flush(&batch, notice);
+    if (watch_fd >= 0)
+      chat_watch_drain(watch_fd, chat_notify, notice);
+  }
 }
 
 /**
  * chatroom — main entry point for the chatroom command.
  *
  * Expected arguments (passed through the shell):
+ *   [--shm]              — create the room with the shared-memory ring
  *   argv[1] = roomname   — logical name of the chat room
  *   argv[2] = username   — display name for this participant
  *
@@ -72,8 +1130,14 @@ void cleanup(int sig) {
 int chatroom(int argc, char *argv[]) {
 
   /* --- Argument validation --- */
+  int use_shm = 0;
+  if (argc > 1 && argv[1] != NULL && strcmp(argv[1], "--shm") == 0) {
+    use_shm = 1;
+    argc--;
+    argv++;
+  }
   if (argc < 3) {
-    fprintf(stderr, "Usage: chatroom <roomname> <username>\n");
+    fprintf(stderr, "Usage: chatroom [--shm] <roomname> <username>\n");
     return 1;
   }
   char *roomname = argv[1];
@@ -99,6 +1163,25 @@ int chatroom(int argc, char *argv[]) {
     return FAILURE;
   }
 
+  /* --- Counters, shared with the reader child --- */
+  stats = mmap(NULL, sizeof(chat_stats_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (stats == MAP_FAILED) {
+    perror("mmap");
+    unlink(user_pipe);
+    return FAILURE;
+  }
+  memset(stats, 0, sizeof(*stats));
+  clock_gettime(CLOCK_MONOTONIC, &stats->start);
+
+  /* --- Transport: a room that has a ring segment always uses it --- */
+  room_ring = chat_ring_open(roomname, use_shm);
+  if (use_shm && room_ring == NULL) {
+    perror("shm_open");
+    unlink(user_pipe);
+    return FAILURE;
+  }
+
   /* --- Signal handlers for graceful cleanup on Ctrl-C or kill --- */
   signal(SIGINT, cleanup);
   signal(SIGTERM, cleanup);
@@ -117,48 +1200,84 @@ int chatroom(int argc, char *argv[]) {
   /* ────────────────────────────────────────────────────────────────
    *  CHILD PROCESS — READER
    *
-   *  Continuously opens the user's own FIFO in read-only mode.
-   *  When another user writes a message, it appears here.
-   *  The pipe is re-opened in a loop so that multiple senders can
-   *  connect over time (each open/close cycle handles one batch).
+   *  Keeps the user's own FIFO open for reading for the whole
+   *  session. Every wake-up drains all queued messages and shows
+   *  them together, followed by one prompt. Room events from
+   *  inotify are polled alongside and shown as join / leave notices.
    * ──────────────────────────────────────────────────────────────── */
   if (reader_pid == 0) {
+    chat_notice_t notice = {roomname, username};
+    int watch_fd = chat_watch_open(room_path);
+
+    if (room_ring != NULL) {
+      chat_ring_t *ring = room_ring;
+      room_ring = NULL; /* membership is the writer's to release */
+      chat_ring_reader(ring, &notice, watch_fd);
+    }
+
+    /* Non-blocking read end, plus a write end of our own that is never
+     * used: with a writer always attached the FIFO never reports EOF, so
+     * there is no reopen after every sender session. */
+    int fd = open(user_pipe, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+      /* Pipe was removed (cleanup ran) — time to exit */
+      exit(0);
+    }
+    int dummy_fd = open(user_pipe, O_WRONLY);
+    (void)dummy_fd;
+
+    chat_batch_t batch = {NULL, 0, 0, NULL, 0, 0};
+    char *pending = malloc(CHAT_READ_BLOCK);
+    size_t pending_len = 0; /* bytes of an incomplete trailing message */
+
     while (1) {
-      /* Blocking open — waits until a writer opens the other end */
-      int fd = open(user_pipe, O_RDONLY);
-      if (fd < 0) {
-        /* Pipe was removed (cleanup ran) — time to exit */
+      struct pollfd pfd[2] = {{fd, POLLIN, 0}, {watch_fd, POLLIN, 0}};
+      if (poll(pfd, watch_fd >= 0 ? 2 : 1, -1) < 0) {
+        if (errno == EINTR)
+          continue;
         exit(0);
       }
+      if (watch_fd >= 0 && pfd[1].revents != 0)
+        chat_watch_drain(watch_fd, chat_notify, &notice);
+      if (pfd[0].revents == 0)
+        continue;
 
-      char buf[1024];
+      /* Drain everything that is queued, then show only whole frames */
       ssize_t n;
-
-      /* Read all available data from this writer session */
-      while ((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
-        buf[n] = '\0';
-
-        /* \r\033[K  = carriage return + clear-to-end-of-line
-         * This overwrites the current prompt so the incoming
-         * message doesn't collide with our typing. */
-        printf("\r\033[K%s", buf);
-
-        /* Reprint the prompt so the user can keep typing */
-        printf("[%s] %s > ", roomname, username);
-        fflush(stdout);
+      while ((n = read(fd, pending + pending_len,
+                       CHAT_READ_BLOCK - pending_len)) > 0) {
+        pending_len += n;
+        size_t used = chat_batch_frames(&batch, &notice, pending, pending_len);
+        memmove(pending, pending + used, pending_len - used);
+        pending_len -= used;
       }
-      close(fd);
+      chat_batch_flush(&batch, &notice);
     }
 
   /* ────────────────────────────────────────────────────────────────
    *  PARENT PROCESS — WRITER
    *
    *  Reads lines from stdin and broadcasts each message to every
-   *  other user in the room by iterating over FIFOs in the room
-   *  directory.
+   *  other user in the room. Descriptors to their FIFOs are opened
+   *  once and kept; membership follows inotify events on the room
+   *  directory (or its mtime where inotify is unavailable).
    * ──────────────────────────────────────────────────────────────── */
   } else {
     char input[1024];
+    uint32_t seq = 0;
+    chat_members_t members = {NULL, 0, 0, -1, {0, 0}, 0};
+
+    /* Watch before the first scan so no join can slip in between */
+    if (room_ring == NULL)
+      members.watch_fd = chat_watch_open(room_path);
+    if (room_ring == NULL &&
+        chat_members_refresh(&members, room_path, username) < 0) {
+      perror("opendir");
+      cleanup(0);
+    }
+
+    /* A member whose reader exits turns our write into EPIPE, not a kill */
+    signal(SIGPIPE, SIG_IGN);
 
     while (1) {
 
@@ -179,83 +1298,34 @@ int chatroom(int argc, char *argv[]) {
       if (strlen(input) == 0)
         continue;
 
-      /* Format the outgoing message:  [roomname] username: message\n */
-      char msg[2048];
-      snprintf(msg, sizeof(msg), "[%s] %s: %s\n", roomname, username, input);
-      size_t msg_len = strlen(msg);
-
-      /* --- Broadcast to all other users in the room --- */
-
-      /* Open the room directory and enumerate all FIFOs */
-      DIR *dir = opendir(room_path);
-      if (dir == NULL) {
-        perror("opendir");
-        break;
+      /* Chat commands stay local */
+      if (strcmp(input, "/stats") == 0) {
+        fflush(stdout);
+        chat_stats_print(STDOUT_FILENO);
+        continue;
       }
 
-      struct dirent *entry;
+      /* Frame the outgoing message; readers format it for display */
+      char msg[CHAT_FRAME_MAX];
+      size_t msg_len = chat_frame_build(msg, username, input, seq++);
 
-      /*
-       * We collect writer child PIDs so we can waitpid() on each one
-       * later, without accidentally reaping the long-lived reader child.
-       */
-      pid_t writer_pids[256];
-      int num_writers = 0;
-
-      while ((entry = readdir(dir)) != NULL) {
-        /* Skip the '.' and '..' pseudo-directories */
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-          continue;
-
-        /* Don't send the message to ourselves */
-        if (strcmp(entry->d_name, username) == 0)
-          continue;
-
-        /*
-         * Fork a short-lived child for each recipient.
-         *
-         * Why fork?  open() on a FIFO blocks until the other side
-         * opens it for reading.  If a recipient is slow or has
-         * disconnected, we don't want to block the whole sender loop.
-         * Each writer child handles one recipient independently.
-         */
-        pid_t writer_pid = fork();
-        if (writer_pid < 0) {
-          perror("fork");
-          continue;
-        }
+      /* --- Broadcast to all other users in the room --- */
 
-        if (writer_pid == 0) {
-          /* ---- Writer child: deliver message to one recipient ---- */
-          char target_pipe[1024];
-          snprintf(target_pipe, sizeof(target_pipe), "%s/%s", room_path,
-                   entry->d_name);
-                   
-          /* O_WRONLY | O_NONBLOCK: fail immediately if no reader */
-          int fd_target = open(target_pipe, O_WRONLY | O_NONBLOCK);
-          if (fd_target < 0) {
-            /* Recipient's pipe isn't being read — skip silently */
-            exit(FAILURE);
-          }
-
-          write(fd_target, msg, msg_len);
-          close(fd_target);
-          exit(0); /* Writer child's job is done */
+      uint64_t t0 = chat_now_us(CLOCK_MONOTONIC);
+      if (room_ring != NULL) {
+        /* --shm room: one copy into the ring reaches everyone */
+        chat_ring_send(room_ring, msg, msg_len);
+      } else {
+        /* Apply joins / leaves, then write to every cached descriptor */
+        if (chat_members_refresh(&members, room_path, username) < 0) {
+          perror("opendir");
+          break;
         }
-
-        /* Parent records the child PID for later reaping */
-        writer_pids[num_writers++] = writer_pid;
-      }
-      closedir(dir);
-
-      /*
-       * Wait ONLY for writer children by PID.
-       * Using plain wait() here would risk reaping the reader child,
-       * which must stay alive for the entire session.
-       */
-      for (int i = 0; i < num_writers; i++) {
-        waitpid(writer_pids[i], NULL, 0);
+        chat_broadcast(&members, room_path, msg, msg_len);
       }
+      chat_hist_add(&stats->fanout, chat_now_us(CLOCK_MONOTONIC) - t0);
+      stats->sent_msgs++;
+      stats->sent_bytes += msg_len;
     }
 
     /* User typed EOF — clean up and exit */
@@ -1,94 +1,697 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/* ─── Data Structures ─── */
+
+#define CUT_READ_BLOCK (1 << 20) // initial read buffer for pipes / ttys
+#define CUT_OUT_BLOCK (1 << 16)  // output is flushed in chunks of this size
+#define CUT_CHUNK (4 << 20)      // work unit of the parallel mode
+
+typedef const char *(*cut_scan_fn)(const char *p, const char *end,
+                                   char delim);
+
+// Inclusive range of 1-indexed fields; hi == INT_MAX for "N-"
+typedef struct {
+  int lo;
+  int hi;
+} cut_range_t;
+
+typedef struct {
+  char delimiter;
+  cut_range_t *ranges; // sorted, non-overlapping field ranges
+  int range_count;
+  int max_field;    // last requested field; scanning stops after it
+  cut_scan_fn scan; // delimiter / newline scanning kernel
+} cut_spec_t;
+
+// Output buffer flushed to a file descriptor with plain write().
+// With fd == -1 it only grows in memory (used by parallel workers).
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+  int fd;
+} cut_out_t;
+
+// Per-chunk output slot of the parallel mode
+typedef struct {
+  cut_out_t out;
+  long chunk; // chunk currently held by the slot, -1 if free
+  bool done;  // worker finished writing the chunk's output
+} cut_slot_t;
+
+// State shared between the parallel workers and the ordered writer
+typedef struct {
+  const cut_spec_t *spec;
+  const char *data; // input, from the current file offset
+  size_t size;
+  long chunks; // number of CUT_CHUNK sized work units
+  long next;   // next chunk to hand out
+  int nslots;
+  cut_slot_t *slots; // chunk i uses slot i % nslots
+  pthread_mutex_t lock;
+  pthread_cond_t slot_free;  // the writer released a slot
+  pthread_cond_t chunk_done; // a worker finished a chunk
+} cut_parallel_t;
+
+/* ─── Output ─── */
+
+/**
+ * cut_flush — writes the buffered output to its file descriptor.
+ *
+ * @param out  Output buffer.
+ */
+static void cut_flush(cut_out_t *out) {
+  size_t done = 0;
+  while (done < out->len) {
+    ssize_t n = write(out->fd, out->data + done, out->len - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("cut: write");
+      break;
+    }
+    done += n;
+  }
+  out->len = 0;
+}
+
+/**
+ * cut_emit — appends a byte slice to the output buffer.
+ *
+ * @param out  Output buffer.
+ * @param p    Start of the slice.
+ * @param n    Length of the slice.
+ */
+static void cut_emit(cut_out_t *out, const char *p, size_t n) {
+  if (out->len + n > out->cap) {
+    if (out->fd < 0) { // in-memory buffer: grow it
+      while (out->len + n > out->cap)
+        out->cap *= 2;
+      out->data = realloc(out->data, out->cap);
+    } else {
+      cut_flush(out);
+      if (n > out->cap) { // larger than the whole buffer: write it through
+        cut_out_t direct = {(char *)p, n, n, out->fd};
+        cut_flush(&direct);
+        return;
+      }
+    }
+  }
+  memcpy(out->data + out->len, p, n);
+  out->len += n;
+}
+
+/* ─── Delimiter Scanning Kernels ─── */
+
+// Each kernel returns the first byte in [p, end) that is either the
+// delimiter or a newline, or end if there is none.
+
+static const char *cut_scan_scalar(const char *p, const char *end,
+                                   char delim) {
+  while (p < end && *p != delim && *p != '\n')
+    p++;
+  return p;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) static const char *
+cut_scan_sse2(const char *p, const char *end, char delim) {
+  const __m128i vd = _mm_set1_epi8(delim);
+  const __m128i vn = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, vd), _mm_cmpeq_epi8(v, vn)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+  return cut_scan_scalar(p, end, delim);
+}
+
+__attribute__((target("avx2"))) static const char *
+cut_scan_avx2(const char *p, const char *end, char delim) {
+  const __m256i vd = _mm256_set1_epi8(delim);
+  const __m256i vn = _mm256_set1_epi8('\n');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, vd), _mm256_cmpeq_epi8(v, vn)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return cut_scan_sse2(p, end, delim);
+}
+#endif
+
+#if defined(__aarch64__)
+static const char *cut_scan_neon(const char *p, const char *end, char delim) {
+  const uint8x16_t vd = vdupq_n_u8((uint8_t)delim);
+  const uint8x16_t vn = vdupq_n_u8('\n');
+  while (end - p >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)p);
+    uint8x16_t eq = vorrq_u8(vceqq_u8(v, vd), vceqq_u8(v, vn));
+    // narrow each byte to a nibble so the match mask fits in 64 bits
+    uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+    if (mask)
+      return p + (__builtin_ctzll(mask) >> 2);
+    p += 16;
+  }
+  return cut_scan_scalar(p, end, delim);
+}
+#endif
+
+typedef struct {
+  const char *name;
+  cut_scan_fn fn;
+} cut_kernel_t;
+
+// Ordered from fastest to slowest; the first supported one is the default
+static const cut_kernel_t cut_kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx2", cut_scan_avx2},
+    {"sse2", cut_scan_sse2},
+#endif
+#if defined(__aarch64__)
+    {"neon", cut_scan_neon},
+#endif
+    {"scalar", cut_scan_scalar},
+};
+
+/**
+ * cut_kernel_supported — checks whether the CPU can run a kernel.
+ *
+ * @param k  Kernel table entry.
+ * @return   true if the kernel can be used on this machine.
+ */
+static bool cut_kernel_supported(const cut_kernel_t *k) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (k->fn == cut_scan_avx2)
+    return __builtin_cpu_supports("avx2");
+  if (k->fn == cut_scan_sse2)
+    return __builtin_cpu_supports("sse2");
+#endif
+  (void)k;
+  return true; // NEON is mandatory on AArch64
+}
+
+/**
+ * cut_select_kernel — picks a scanning kernel by name, or the fastest
+ * supported one when name is NULL.
+ *
+ * @param name  Kernel name from --kernel, or NULL.
+ * @return      Scanning function, or NULL if unknown / unsupported.
+ */
+static cut_scan_fn cut_select_kernel(const char *name) {
+  for (size_t i = 0; i < sizeof(cut_kernels) / sizeof(cut_kernels[0]); i++) {
+    if (name != NULL && strcmp(name, cut_kernels[i].name) != 0)
+      continue;
+    if (cut_kernel_supported(&cut_kernels[i]))
+      return cut_kernels[i].fn;
+    if (name != NULL)
+      return NULL;
+  }
+  return NULL;
+}
+
+/* ─── Field List ─── */
+
+static int cut_range_compare(const void *a, const void *b) {
+  const cut_range_t *x = a, *y = b;
+  return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+/**
+ * cut_parse_fields — adds a field list such as "1,3-5,8-" to the spec.
+ * Each entry is N, N-M, N- (to the end of the line) or -M (from field 1).
+ *
+ * @param list  Field list from -f.
+ * @param spec  Spec to add the ranges to.
+ * @return      0 on success, -1 if the list is invalid.
+ */
+static int cut_parse_fields(const char *list, cut_spec_t *spec) {
+  const char *p = list;
+  while (1) {
+    cut_range_t r = {1, INT_MAX};
+    char *endp;
+
+    if (*p != '-') {
+      long lo = strtol(p, &endp, 10);
+      if (endp == p || lo < 1 || lo > INT_MAX)
+        return -1;
+      r.lo = r.hi = (int)lo;
+      p = endp;
+    }
+    if (*p == '-') {
+      p++;
+      if (*p >= '0' && *p <= '9') {
+        long hi = strtol(p, &endp, 10);
+        if (hi < r.lo || hi > INT_MAX)
+          return -1;
+        r.hi = (int)hi;
+        p = endp;
+      } else if (p == list + 1) { // a lone "-"
+        return -1;
+      } else {
+        r.hi = INT_MAX;
+      }
+    }
+    if (*p != ',' && *p != '\0')
+      return -1;
+
+    spec->ranges =
+        realloc(spec->ranges, sizeof(cut_range_t) * (spec->range_count + 1));
+    spec->ranges[spec->range_count++] = r;
+
+    if (*p == '\0')
+      break;
+    list = ++p;
+  }
+  return 0;
+}
+
+/**
+ * cut_compile_fields — sorts and merges the ranges so that a line can be
+ * matched against them with one forward-moving cursor.
+ *
+ * @param spec  Spec whose ranges are compiled in place.
+ */
+static void cut_compile_fields(cut_spec_t *spec) {
+  qsort(spec->ranges, spec->range_count, sizeof(cut_range_t),
+        cut_range_compare);
+
+  int n = 0;
+  for (int i = 0; i < spec->range_count; i++) {
+    if (n > 0 && spec->ranges[i].lo <= spec->ranges[n - 1].hi + 1LL) {
+      if (spec->ranges[i].hi > spec->ranges[n - 1].hi)
+        spec->ranges[n - 1].hi = spec->ranges[i].hi;
+    } else {
+      spec->ranges[n++] = spec->ranges[i];
+    }
+  }
+  spec->range_count = n;
+  spec->max_field = n > 0 ? spec->ranges[n - 1].hi : 0;
+}
+
+/* ─── Field Extraction ─── */
+
+/**
+ * cut_block — processes a block of complete lines in a single pass,
+ * jumping from one delimiter / newline to the next with the selected
+ * scanning kernel. Selected fields are written out as soon as they end;
+ * the remainder of a line after the last requested field is skipped
+ * with memchr().
+ *
+ * @param spec  Parsed options.
+ * @param p     Start of the block.
+ * @param n     Length of the block; only the last line may lack a newline.
+ * @param out   Output buffer.
+ */
+static void cut_block(const cut_spec_t *spec, const char *p, size_t n,
+                      cut_out_t *out) {
+  const char *end = p + n;
+
+  while (p < end) {
+    int field = 1;   // 1-indexed number of the current field
+    int r = 0;       // first range that may still match
+    int printed = 0; // fields written for this line
+
+    while (1) {
+      const char *q = spec->scan(p, end, spec->delimiter);
+
+      while (r < spec->range_count && spec->ranges[r].hi < field)
+        r++;
+      if (r < spec->range_count && field >= spec->ranges[r].lo) {
+        if (printed++ > 0)
+          cut_emit(out, &spec->delimiter, 1);
+        cut_emit(out, p, q - p);
+      }
+
+      if (q == end) { // last line without a newline
+        p = end;
+        break;
+      }
+      p = q + 1;
+      if (*q == '\n')
+        break;
+      if (++field > spec->max_field) { // nothing else wanted on this line
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+        break;
+      }
+    }
+    cut_emit(out, "\n", 1);
+  }
+}
+
+/* ─── Parallel Mode ─── */
+
+/**
+ * cut_chunk_start — finds where chunk i begins: the first line start at
+ * or after its nominal offset. Every worker derives the same boundaries
+ * on its own, so no line is split or processed twice.
+ *
+ * @param par  Parallel state.
+ * @param i    Chunk index (may be par->chunks for the end).
+ * @return     Byte offset into par->data.
+ */
+static size_t cut_chunk_start(const cut_parallel_t *par, long i) {
+  if (i <= 0)
+    return 0;
+  size_t pos = (size_t)i * CUT_CHUNK;
+  if (pos >= par->size)
+    return par->size;
+  const char *nl = memchr(par->data + pos - 1, '\n', par->size - pos + 1);
+  return nl ? (size_t)(nl + 1 - par->data) : par->size;
+}
+
+/**
+ * cut_worker — thread body: takes the next chunk whose slot is free and
+ * runs the streaming kernel over it into the slot's buffer.
+ *
+ * @param arg  Parallel state.
+ * @return     NULL.
+ */
+static void *cut_worker(void *arg) {
+  cut_parallel_t *par = arg;
+
+  pthread_mutex_lock(&par->lock);
+  while (par->next < par->chunks) {
+    long i = par->next;
+    cut_slot_t *slot = &par->slots[i % par->nslots];
+    if (slot->chunk != -1) { // still holds output the writer hasn't sent
+      pthread_cond_wait(&par->slot_free, &par->lock);
+      continue;
+    }
+    par->next++;
+    slot->chunk = i;
+    slot->done = false;
+    pthread_mutex_unlock(&par->lock);
+
+    size_t start = cut_chunk_start(par, i);
+    size_t end = cut_chunk_start(par, i + 1);
+    slot->out.len = 0;
+    if (start < end)
+      cut_block(par->spec, par->data + start, end - start, &slot->out);
+
+    pthread_mutex_lock(&par->lock);
+    slot->done = true;
+    pthread_cond_broadcast(&par->chunk_done);
+  }
+  pthread_mutex_unlock(&par->lock);
+  return NULL;
+}
+
+/**
+ * cut_parallel — processes an in-memory input on several threads. The
+ * input is split into newline-aligned chunks, and the calling thread
+ * writes each chunk's output in input order as soon as it is ready.
+ *
+ * @param spec  Parsed options.
+ * @param data  Input.
+ * @param size  Input length.
+ * @param jobs  Number of worker threads.
+ * @param out   Output buffer (its fd receives the results).
+ * @return      0 on success, -1 if no worker could be started.
+ */
+static int cut_parallel(const cut_spec_t *spec, const char *data,
+                        size_t size, int jobs, cut_out_t *out) {
+  cut_parallel_t par;
+  par.spec = spec;
+  par.data = data;
+  par.size = size;
+  par.chunks = (long)((size + CUT_CHUNK - 1) / CUT_CHUNK);
+  par.next = 0;
+  par.nslots = jobs * 2; // lets workers run ahead of the writer
+  par.slots = calloc(par.nslots, sizeof(cut_slot_t));
+  for (int i = 0; i < par.nslots; i++) {
+    par.slots[i].out.cap = CUT_OUT_BLOCK;
+    par.slots[i].out.data = malloc(CUT_OUT_BLOCK);
+    par.slots[i].out.fd = -1;
+    par.slots[i].chunk = -1;
+  }
+  pthread_mutex_init(&par.lock, NULL);
+  pthread_cond_init(&par.slot_free, NULL);
+  pthread_cond_init(&par.chunk_done, NULL);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+  int started = 0;
+  for (int i = 0; i < jobs; i++)
+    if (pthread_create(&threads[started], NULL, cut_worker, &par) == 0)
+      started++;
+
+  if (started > 0) {
+    cut_flush(out);
+    for (long i = 0; i < par.chunks; i++) {
+      cut_slot_t *slot = &par.slots[i % par.nslots];
+
+      pthread_mutex_lock(&par.lock);
+      while (slot->chunk != i || !slot->done)
+        pthread_cond_wait(&par.chunk_done, &par.lock);
+      pthread_mutex_unlock(&par.lock);
+
+      cut_out_t w = {slot->out.data, slot->out.len, slot->out.cap, out->fd};
+      cut_flush(&w);
+
+      pthread_mutex_lock(&par.lock);
+      slot->chunk = -1;
+      pthread_cond_broadcast(&par.slot_free);
+      pthread_mutex_unlock(&par.lock);
+    }
+    for (int i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < par.nslots; i++)
+    free(par.slots[i].out.data);
+  free(par.slots);
+  free(threads);
+  pthread_mutex_destroy(&par.lock);
+  pthread_cond_destroy(&par.slot_free);
+  pthread_cond_destroy(&par.chunk_done);
+  return started > 0 ? 0 : -1;
+}
+
+/* ─── Input ─── */
+
+/**
+ * cut_mapped — processes a regular file on fd by mapping it into memory.
+ *
+ * @param spec  Parsed options.
+ * @param fd    Input file descriptor (a regular file).
+ * @param size  File size.
+ * @param jobs  Worker threads; more than one enables the parallel mode.
+ * @param out   Output buffer.
+ * @return      0 on success, -1 if the file could not be mapped or its
+ *              size is unknown.
+ */
+static int cut_mapped(const cut_spec_t *spec, int fd, off_t size, int jobs,
+                      cut_out_t *out) {
+  if (size <= 0) // /proc and friends report 0 but do have content
+    return -1;
+  off_t offset = lseek(fd, 0, SEEK_CUR); // the shell may have read ahead
+  if (offset < 0)
+    offset = 0;
+  if (offset >= size)
+    return 0;
+
+  char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  // small inputs are not worth the thread start-up
+  size_t len = size - offset;
+  if (jobs <= 1 || len <= CUT_CHUNK ||
+      cut_parallel(spec, map + offset, len, jobs, out) < 0)
+    cut_block(spec, map + offset, len, out);
+
+  munmap(map, size);
+  lseek(fd, size, SEEK_SET);
+  return 0;
+}
+
+/**
+ * cut_stream — processes a pipe or terminal with large block reads.
+ * Only complete lines are handed to cut_block(); a line that does not fit
+ * the buffer grows it, so any line length works. When either end is a
+ * terminal the output is flushed after every block, so typed lines are
+ * answered at once; pipes and files stay fully buffered.
+ *
+ * @param spec  Parsed options.
+ * @param fd    Input file descriptor.
+ * @param out   Output buffer.
+ */
+static void cut_stream(const cut_spec_t *spec, int fd, cut_out_t *out) {
+  size_t cap = CUT_READ_BLOCK;
+  size_t len = 0;
+  char *buf = malloc(cap);
+  bool interactive = isatty(fd) || isatty(out->fd);
+
+  while (1) {
+    if (len == cap) { // a single line fills the buffer
+      cap *= 2;
+      buf = realloc(buf, cap);
+    }
+    ssize_t n = read(fd, buf + len, cap - len);
+    if (n < 0) {
+      if (errno == EINTR) // Ctrl+C in the shell, which cut may run in
+        break;
+      perror("cut: read");
+      break;
+    }
+    if (n == 0) { // EOF: the rest is the last line
+      cut_block(spec, buf, len, out);
+      break;
+    }
+
+    size_t scanned = len;
+    len += n;
+    // find the last newline in the new data; nothing to do until one
+    // arrives
+    size_t used = len;
+    while (used > scanned && buf[used - 1] != '\n')
+      used--;
+    if (used == scanned)
+      continue;
+
+    cut_block(spec, buf, used, out);
+    if (interactive)
+      cut_flush(out);
+    memmove(buf, buf + used, len - used);
+    len -= used;
+  }
+  free(buf);
+}
+
+/* ─── Main Entry Point ─── */
+
+/**
+ * cut_parse_jobs — parses the -j thread count; 0 means one per CPU.
+ *
+ * @param arg   Option value.
+ * @param jobs  Receives the thread count.
+ * @return      0 on success, -1 if the value is invalid.
+ */
+static int cut_parse_jobs(const char *arg, int *jobs) {
+  char *endp;
+  long n = strtol(arg, &endp, 10);
+  if (endp == arg || *endp != '\0' || n < 0 || n > 1024)
+    return -1;
+  if (n == 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  *jobs = n > 0 ? (int)n : 1;
+  return 0;
+}
+
 /**
  * handle_cut — main entry point for the cut command.
  *
  * Expected arguments (passed through the shell):
  *   argv[1] = delimiter   — delimiter character
- *   argv[2] = fields      — fields to print
+ *   argv[2] = fields      — fields to print: N, N-M, N- or -M, comma
+ *                           separated; printed once each, in field order
+ *   -j <N>                — worker threads for regular-file input
+ *                           (0 = one per CPU); pipes stay sequential
+ *   --kernel <name>       — scanning kernel (avx2, sse2, neon, scalar),
+ *                           for benchmarking; default is the fastest one
  *
  * @param argc  Argument count (must be >= 2).
  * @param argv  Argument vector.
  */
 void handle_cut(int argc, char *argv[]) {
-  char delimiter = '\t'; // default TAB
-  int fields[100];       // field list
-  int field_count = 0;
+  cut_spec_t spec = {'\t', NULL, 0, 0, NULL}; // default TAB
+  const char *kernel = NULL; // scanning kernel, NULL = best available
+  const char *bad_list = NULL;
+  int jobs = 1; // worker threads for regular files
+  bool bad_jobs = false;
 
   for (int i = 1; i < argc; i++) {
     if (argv[i] == NULL)
       break;
 
     if ((strcmp(argv[i], "-d") == 0) || (strcmp(argv[i], "--delimiter") == 0)) {
-      if (i + 1 < argc) {
-        delimiter = argv[++i][0];
+      if (i + 1 < argc && argv[i + 1] != NULL) {
+        spec.delimiter = argv[++i][0];
       }
+    } else if (strcmp(argv[i], "--kernel") == 0) {
+      if (i + 1 < argc && argv[i + 1] != NULL)
+        kernel = argv[++i];
+    } else if ((strcmp(argv[i], "-j") == 0) ||
+               (strcmp(argv[i], "--jobs") == 0)) {
+      if (i + 1 < argc && argv[i + 1] != NULL)
+        bad_jobs |= cut_parse_jobs(argv[++i], &jobs) < 0;
+    } else if (strncmp(argv[i], "-j", 2) == 0 && strlen(argv[i]) > 2) {
+      // combined format: -j8
+      bad_jobs |= cut_parse_jobs(argv[i] + 2, &jobs) < 0;
     } else if (strncmp(argv[i], "-d", 2) == 0 && strlen(argv[i]) > 2) {
       // combined format: -d:
-      delimiter = argv[i][2];
+      spec.delimiter = argv[i][2];
     } else if ((strcmp(argv[i], "-f") == 0) ||
                (strcmp(argv[i], "--fields") == 0)) {
-      if (i + 1 < argc) {
-        char *token = strtok(argv[++i], ",");
-        while (token != NULL && field_count < 100) {
-          fields[field_count++] = atoi(token);
-          token = strtok(NULL, ",");
-        }
+      if (i + 1 < argc && argv[i + 1] != NULL) {
+        if (cut_parse_fields(argv[++i], &spec) < 0)
+          bad_list = argv[i];
       }
     } else if (strncmp(argv[i], "-f", 2) == 0 && strlen(argv[i]) > 2) {
-      // combined format: -f1,3
-      char *field_str = argv[i] + 2;
-      char field_copy[1024];
-      strncpy(field_copy, field_str, sizeof(field_copy) - 1);
-      field_copy[sizeof(field_copy) - 1] = '\0';
-      char *token = strtok(field_copy, ",");
-      while (token != NULL && field_count < 100) {
-        fields[field_count++] = atoi(token);
-        token = strtok(NULL, ",");
-      }
+      // combined format: -f1,3 or -f3-7
+      if (cut_parse_fields(argv[i] + 2, &spec) < 0)
+        bad_list = argv[i] + 2;
     }
   }
 
-  char line[4096];
-  while (fgets(line, sizeof(line), stdin)) {
-    line[strcspn(line, "\n")] = '\0';
+  if (bad_jobs) {
+    fprintf(stderr, "cut: -j expects a thread count (0 = all CPUs)\n");
+    free(spec.ranges);
+    return;
+  }
+  if (bad_list != NULL) {
+    fprintf(stderr, "cut: invalid field list: '%s'\n", bad_list);
+    free(spec.ranges);
+    return;
+  }
+  cut_compile_fields(&spec);
+
+  spec.scan = cut_select_kernel(kernel);
+  if (spec.scan == NULL) {
+    fprintf(stderr, "cut: kernel '%s' is not available on this machine\n",
+            kernel);
+    free(spec.ranges);
+    return;
+  }
 
-    char *tokens[100];
-    int total_token = 0;
+  cut_out_t out = {malloc(CUT_OUT_BLOCK), 0, CUT_OUT_BLOCK, STDOUT_FILENO};
 
-    char *start = line;
-    char *ptr = line;
-    while (*ptr != '\0') {
-      if (*ptr == delimiter) {
-        *ptr = '\0'; // change delimiter to null
-        tokens[total_token++] = start;
-        start = ptr + 1;
-        if (total_token >= 100)
-          break;
-      }
-      ptr++;
-    }
-    // add last token
-    if (total_token < 100) {
-      tokens[total_token++] = start;
-    }
+  // input and output go straight through fds 0 and 1; pipes and
+  // terminals are always processed sequentially: cut may run inside
+  // the shell process, whose own stdio buffers must stay untouched
+  fflush(stdout);
 
-    // print fields
-    for (int i = 0; i < field_count; i++) {
-      int target = fields[i]; // 1-indexed
-      if (target >= 1 && target <= total_token) {
-        if (i > 0) {
-          printf("%c", delimiter);
-        }
-        printf("%s", tokens[target - 1]);
-      }
-    }
-    printf("\n");
-  }
-}
\ No newline at end of file
+  struct stat st;
+  if (fstat(STDIN_FILENO, &st) < 0 || !S_ISREG(st.st_mode) ||
+      cut_mapped(&spec, STDIN_FILENO, st.st_size, jobs, &out) < 0)
+    cut_stream(&spec, STDIN_FILENO, &out);
+
+  cut_flush(&out);
+  free(out.data);
+  free(spec.ranges);
+}
@@ -1,150 +1,1181 @@
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "process_tree.h"
+
 /* ─── Data Structure ─── */
 
+// Process snapshot as parallel arrays; names live in one shared arena so
+// an entry costs a few bytes instead of a fixed 256-byte buffer
+struct proc_snapshot {
+  int *pid;
+  int *ppid;
+  unsigned *name; // offset of the NUL-terminated name in names
+  char *state;    // R, S, D, Z, ...
+  long *rss_kb;   // resident set size
+  unsigned long long *cpu_ticks; // utime + stime, in clock ticks
+  int *threads;
+  int count;
+  int cap;
+  char *names; // string arena
+  size_t names_len;
+  size_t names_cap;
+};
+
+// Fields of one /proc/<pid>/stat line
 typedef struct {
   int pid;
   int ppid;
-  char name[256];
-} proc_info_t;
+  char state;
+  char name[64]; // comm, may contain spaces and parentheses
+  long rss_kb;
+  unsigned long long cpu_ticks; // utime + stime
+  int threads;
+} proc_stat_t;
+
+#define PROC_SCAN_MIN_PER_JOB 512 // smaller scans are not worth a thread
 
-#define MAX_PROCS 4096
+extern pid_t shell_pid; // defined in shellish-skeleton.c
 
 /* ─── /proc Scanning ─── */
 
-// Reads PID, PPID and process name from /proc/<pid>/status
 /**
- * read_proc_status — main entry point for the read_proc_status command.
+ * proc_table_push — appends an empty entry with the given name, growing
+ * the arrays and the name arena geometrically.
+ *
+ * @param t     Process table.
+ * @param name  Process name.
+ * @return      Index of the new entry.
+ */
+static int proc_table_push(proc_snapshot_t *t, const char *name) {
+  if (t->count == t->cap) {
+    t->cap = t->cap ? t->cap * 2 : 256;
+    t->pid = realloc(t->pid, sizeof(int) * t->cap);
+    t->ppid = realloc(t->ppid, sizeof(int) * t->cap);
+    t->name = realloc(t->name, sizeof(unsigned) * t->cap);
+    t->state = realloc(t->state, sizeof(char) * t->cap);
+    t->rss_kb = realloc(t->rss_kb, sizeof(long) * t->cap);
+    t->cpu_ticks = realloc(t->cpu_ticks, sizeof(unsigned long long) * t->cap);
+    t->threads = realloc(t->threads, sizeof(int) * t->cap);
+  }
+  size_t len = strlen(name) + 1;
+  if (t->names_len + len > t->names_cap) {
+    t->names_cap = t->names_cap ? t->names_cap * 2 : 4096;
+    while (t->names_len + len > t->names_cap)
+      t->names_cap *= 2;
+    t->names = realloc(t->names, t->names_cap);
+  }
+  memcpy(t->names + t->names_len, name, len);
+
+  t->name[t->count] = (unsigned)t->names_len;
+  t->names_len += len;
+  return t->count++;
+}
+
+/**
+ * proc_table_add — appends one freshly read process.
+ *
+ * @param t   Process table.
+ * @param st  Parsed /proc/<pid>/stat fields.
+ */
+static void proc_table_add(proc_snapshot_t *t, const proc_stat_t *st) {
+  int i = proc_table_push(t, st->name);
+  t->pid[i] = st->pid;
+  t->ppid[i] = st->ppid;
+  t->state[i] = st->state;
+  t->rss_kb[i] = st->rss_kb;
+  t->cpu_ticks[i] = st->cpu_ticks;
+  t->threads[i] = st->threads;
+}
+
+/**
+ * proc_table_copy — appends entry i of another table.
+ *
+ * @param t    Destination table.
+ * @param src  Source table.
+ * @param i    Entry in src.
+ */
+static void proc_table_copy(proc_snapshot_t *t, const proc_snapshot_t *src,
+                            int i) {
+  int k = proc_table_push(t, src->names + src->name[i]);
+  t->pid[k] = src->pid[i];
+  t->ppid[k] = src->ppid[i];
+  t->state[k] = src->state[i];
+  t->rss_kb[k] = src->rss_kb[i];
+  t->cpu_ticks[k] = src->cpu_ticks[i];
+  t->threads[k] = src->threads[i];
+}
+
+static const char *proc_name(const proc_snapshot_t *t, int i) {
+  return t->names + t->name[i];
+}
+
+static void proc_table_free(proc_snapshot_t *t) {
+  free(t->pid);
+  free(t->ppid);
+  free(t->name);
+  free(t->state);
+  free(t->rss_kb);
+  free(t->cpu_ticks);
+  free(t->threads);
+  free(t->names);
+}
+
+/**
+ * parse_int — parses a non-negative decimal number without sscanf.
  *
- * @param pid_str  PID string.
- * @param info     Pointer to proc_info_t structure to store the result.
- * @return         0 on success, -1 on error.
+ * @param p    Input cursor, advanced past the digits.
+ * @param out  Parsed value.
+ * @return     0 on success, -1 if there are no digits.
  */
-static int read_proc_status(const char *pid_str, proc_info_t *info) {
-  char path[512];
-  snprintf(path, sizeof(path), "/proc/%s/status", pid_str);
+static int parse_int(const char **p, int *out) {
+  const char *s = *p;
+  int v = 0;
+  if (*s < '0' || *s > '9')
+    return -1;
+  while (*s >= '0' && *s <= '9')
+    v = v * 10 + (*s++ - '0');
+  *out = v;
+  *p = s;
+  return 0;
+}
 
-  FILE *fp = fopen(path, "r");
-  if (!fp)
+/**
+ * parse_ull — parses an unsigned decimal number without sscanf.
+ *
+ * @param p    Input cursor, advanced past the digits.
+ * @param out  Parsed value.
+ * @return     0 on success, -1 if there are no digits.
+ */
+static int parse_ull(const char **p, unsigned long long *out) {
+  const char *s = *p;
+  unsigned long long v = 0;
+  if (*s < '0' || *s > '9')
     return -1;
+  while (*s >= '0' && *s <= '9')
+    v = v * 10 + (*s++ - '0');
+  *out = v;
+  *p = s;
+  return 0;
+}
 
-  int got_name = 0, got_pid = 0, got_ppid = 0;
-  char line[512];
+/**
+ * skip_fields — moves past n space-separated fields.
+ *
+ * @param p  Input cursor, positioned at the start of a field.
+ * @param n  Number of fields to skip.
+ * @return   Start of the next field, or NULL if the line ends first.
+ */
+static const char *skip_fields(const char *p, int n) {
+  while (n-- > 0) {
+    p = strchr(p, ' ');
+    if (p == NULL)
+      return NULL;
+    p++;
+  }
+  return p;
+}
 
-  while (fgets(line, sizeof(line), fp)) {
-    if (strncmp(line, "Name:", 5) == 0) {
-      sscanf(line + 5, " %255s", info->name);
-      got_name = 1;
-    } else if (strncmp(line, "Pid:", 4) == 0) {
-      sscanf(line + 4, " %d", &info->pid);
-      got_pid = 1;
-    } else if (strncmp(line, "PPid:", 5) == 0) {
-      sscanf(line + 5, " %d", &info->ppid);
-      got_ppid = 1;
-    }
-    if (got_name && got_pid && got_ppid)
-      break;
+/**
+ * proc_read_stat — reads one process from /proc/<pid>/stat with a single
+ * openat() + read() into a stack buffer and parses it by hand.
+ *
+ * The comm field is wrapped in parentheses and may itself contain ')'
+ * and spaces, so it ends at the *last* ')' of the line.
+ *
+ * @param proc_fd  Directory fd of /proc.
+ * @param pid      PID to read.
+ * @param page_kb  Page size in KiB, for the rss column.
+ * @param st       Parsed fields.
+ * @return         0 on success, -1 if the process vanished or is malformed.
+ */
+static int proc_read_stat(int proc_fd, int pid, long page_kb,
+                          proc_stat_t *st) {
+  // "<pid>/stat" without going through snprintf
+  char path[32];
+  char digits[16];
+  int nd = 0;
+  do {
+    digits[nd++] = '0' + pid % 10;
+    pid /= 10;
+  } while (pid > 0);
+  for (int i = 0; i < nd; i++)
+    path[i] = digits[nd - 1 - i];
+  memcpy(path + nd, "/stat", sizeof("/stat"));
+
+  int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  char buf[1024];
+  ssize_t len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+
+  const char *p = buf;
+  if (parse_int(&p, &st->pid) < 0 || p[0] != ' ' || p[1] != '(')
+    return -1;
+  const char *name = p + 2;
+  const char *end = strrchr(name, ')');
+  if (end == NULL || end[1] != ' ')
+    return -1;
+  size_t name_len = end - name;
+  if (name_len >= sizeof(st->name))
+    name_len = sizeof(st->name) - 1;
+  memcpy(st->name, name, name_len);
+  st->name[name_len] = '\0';
+
+  // ") S ppid ..."
+  p = end + 2;
+  st->state = *p++;
+  if (*p++ != ' ' || parse_int(&p, &st->ppid) < 0)
+    return -1;
+
+  // resource columns from the same line (field numbers as in proc(5)):
+  // 14 utime, 15 stime, 20 num_threads, 24 rss (pages)
+  unsigned long long utime, stime, rss;
+  p = skip_fields(p + 1, 9); // fields 5..13
+  if (p == NULL || parse_ull(&p, &utime) < 0 || *p++ != ' ' ||
+      parse_ull(&p, &stime) < 0)
+    return -1;
+  p = skip_fields(p + 1, 4); // fields 16..19
+  if (p == NULL || parse_int(&p, &st->threads) < 0)
+    return -1;
+  p = skip_fields(p + 1, 3); // fields 21..23
+  if (p == NULL || parse_ull(&p, &rss) < 0)
+    return -1;
+  st->cpu_ticks = utime + stime;
+  st->rss_kb = (long)rss * page_kb;
+  return 0;
+}
+
+/**
+ * list_proc_pids — collects the PIDs of all numeric directories in /proc.
+ *
+ * @param dir    Open /proc directory stream.
+ * @param count  Number of PIDs returned.
+ * @return       Array of PIDs in readdir order (caller frees).
+ */
+static int *list_proc_pids(DIR *dir, int *count) {
+  int cap = 1024;
+  int *pids = malloc(sizeof(int) * cap);
+  struct dirent *entry;
+  const char *p;
+  int pid;
+
+  *count = 0;
+  while ((entry = readdir(dir)) != NULL) {
+    // Only numeric directories are processes
+    p = entry->d_name;
+    if (parse_int(&p, &pid) < 0 || *p != '\0')
+      continue;
+    if (*count == cap) {
+      cap *= 2;
+      pids = realloc(pids, sizeof(int) * cap);
+    }
+    pids[(*count)++] = pid;
   }
+  return pids;
+}
 
-  fclose(fp);
-  return (got_name && got_pid && got_ppid) ? 0 : -1;
+// One worker's share of a parallel /proc scan
+typedef struct {
+  int proc_fd;
+  const int *pids;
+  int begin;
+  int end;
+  long page_kb;
+  proc_snapshot_t part; // filled by the worker alone
+} proc_scan_job_t;
+
+/**
+ * proc_scan_worker — thread body: reads the stat files of a contiguous
+ * slice of the PID list into the job's private table.
+ *
+ * @param arg  proc_scan_job_t.
+ * @return     NULL.
+ */
+static void *proc_scan_worker(void *arg) {
+  proc_scan_job_t *job = arg;
+  proc_stat_t st;
+  for (int i = job->begin; i < job->end; i++)
+    if (proc_read_stat(job->proc_fd, job->pids[i], job->page_kb, &st) == 0)
+      proc_table_add(&job->part, &st);
+  return NULL;
 }
 
-// Scans all numeric directories under /proc to build the process list
 /**
- * read_all_procs — main entry point for the read_all_procs command.
+ * read_all_procs — scans all numeric directories under /proc to build the
+ * process list. With jobs > 1 the PID list is split into contiguous
+ * slices read by a small thread pool, and the slices are appended in
+ * order, so the result matches a serial scan.
  *
- * @param procs  Pointer to array of proc_info_t structures to store the result.
- * @return       Number of processes read, or 0 on error.
+ * @param t     Empty snapshot to fill; release with proc_table_free().
+ * @param jobs  Worker threads (1 = serial scan).
+ * @return      Number of processes read, or 0 on error.
  */
-static int read_all_procs(proc_info_t *procs) {
+static int read_all_procs(proc_snapshot_t *t, int jobs) {
   DIR *dir = opendir("/proc");
   if (!dir) {
     perror("opendir /proc");
     return 0;
   }
 
-  int count = 0;
-  struct dirent *entry;
+  int proc_fd = dirfd(dir);
+  int npids;
+  int *pids = list_proc_pids(dir, &npids);
 
-  while ((entry = readdir(dir)) != NULL && count < MAX_PROCS) {
-    // Only numeric directories are processes
-    if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
-      continue;
+  if (jobs > npids / PROC_SCAN_MIN_PER_JOB)
+    jobs = npids / PROC_SCAN_MIN_PER_JOB;
+  if (jobs < 1)
+    jobs = 1;
+
+  proc_scan_job_t *job = calloc(jobs, sizeof(proc_scan_job_t));
+  pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+  long page_kb = sysconf(_SC_PAGESIZE) / 1024; // before the workers start
+  for (int i = 0; i < jobs; i++) {
+    job[i].proc_fd = proc_fd;
+    job[i].pids = pids;
+    job[i].begin = (int)((long)npids * i / jobs);
+    job[i].end = (int)((long)npids * (i + 1) / jobs);
+    job[i].page_kb = page_kb;
+  }
 
-    if (read_proc_status(entry->d_name, &procs[count]) == 0)
-      count++;
+  // the calling thread takes slice 0 itself; a slice whose thread could
+  // not be started is read serially afterwards
+  int *started = calloc(jobs, sizeof(int));
+  for (int i = 1; i < jobs; i++)
+    started[i] =
+        pthread_create(&threads[i], NULL, proc_scan_worker, &job[i]) == 0;
+  proc_scan_worker(&job[0]);
+  for (int i = 1; i < jobs; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+    else
+      proc_scan_worker(&job[i]);
   }
 
+  if (jobs == 1) { // serial scan: take the table over as is
+    *t = job[0].part;
+  } else {
+    for (int i = 0; i < jobs; i++) {
+      proc_snapshot_t *part = &job[i].part;
+      for (int k = 0; k < part->count; k++)
+        proc_table_copy(t, part, k);
+      proc_table_free(part);
+    }
+  }
+
+  free(started);
+  free(threads);
+  free(job);
+  free(pids);
   closedir(dir);
-  return count;
+  return t->count;
+}
+
+/* ─── Snapshot API ─── */
+
+// Declared in process_tree.h: other built-ins only see proc_snapshot_t
+// as an opaque type and go through these accessors.
+
+/**
+ * proc_snapshot_take — reads every process currently in /proc.
+ *
+ * @param jobs  Threads used for the scan; 0 = one per CPU, 1 = serial.
+ * @return      New snapshot (release with proc_snapshot_free()), or NULL.
+ */
+proc_snapshot_t *proc_snapshot_take(int jobs) {
+  proc_snapshot_t *t = calloc(1, sizeof(proc_snapshot_t));
+  if (t == NULL)
+    return NULL;
+  if (jobs == 0)
+    jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (read_all_procs(t, jobs) == 0) {
+    proc_table_free(t);
+    free(t);
+    return NULL;
+  }
+  return t;
+}
+
+void proc_snapshot_free(proc_snapshot_t *t) {
+  if (t == NULL)
+    return;
+  proc_table_free(t);
+  free(t);
+}
+
+int proc_snapshot_count(const proc_snapshot_t *t) { return t->count; }
+
+int proc_snapshot_pid(const proc_snapshot_t *t, int i) { return t->pid[i]; }
+
+int proc_snapshot_ppid(const proc_snapshot_t *t, int i) { return t->ppid[i]; }
+
+const char *proc_snapshot_name(const proc_snapshot_t *t, int i) {
+  return proc_name(t, i);
+}
+
+char proc_snapshot_state(const proc_snapshot_t *t, int i) {
+  return t->state[i];
+}
+
+long proc_snapshot_rss_kb(const proc_snapshot_t *t, int i) {
+  return t->rss_kb[i];
+}
+
+unsigned long long proc_snapshot_cpu_ticks(const proc_snapshot_t *t, int i) {
+  return t->cpu_ticks[i];
+}
+
+int proc_snapshot_threads(const proc_snapshot_t *t, int i) {
+  return t->threads[i];
+}
+
+/* ─── Tree Building ─── */
+
+// pid -> table index, open addressing with linear probing
+typedef struct {
+  int *pids;
+  int *index;
+  int cap; // power of two, at least twice the process count
+} pid_map_t;
+
+// First-child / next-sibling links over the process table
+typedef struct {
+  pid_map_t map;
+  int *first_child;
+  int *next_sibling;
+} proc_tree_t;
+
+static unsigned pid_hash(int pid) { return (unsigned)pid * 2654435761u; }
+
+/**
+ * pid_map_find — looks up the table index of a PID.
+ *
+ * @param map  PID map.
+ * @param pid  PID to look up.
+ * @return     Table index, or -1 if the PID is not in the snapshot.
+ */
+static int pid_map_find(const pid_map_t *map, int pid) {
+  unsigned mask = map->cap - 1;
+  for (unsigned h = pid_hash(pid) & mask;; h = (h + 1) & mask) {
+    if (map->index[h] == -1)
+      return -1;
+    if (map->pids[h] == pid)
+      return map->index[h];
+  }
+}
+
+/**
+ * pid_map_build — indexes an array of PIDs.
+ *
+ * @param map    Map to fill; release with pid_map_free().
+ * @param pids   PIDs; the map returns indexes into this array.
+ * @param count  Number of PIDs.
+ */
+static void pid_map_build(pid_map_t *map, const int *pids, int count) {
+  int cap = 16;
+  while (cap < count * 2)
+    cap *= 2;
+  map->cap = cap;
+  map->pids = malloc(sizeof(int) * cap);
+  map->index = malloc(sizeof(int) * cap);
+  memset(map->index, -1, sizeof(int) * cap);
+
+  unsigned mask = cap - 1;
+  for (int i = 0; i < count; i++) {
+    unsigned h = pid_hash(pids[i]) & mask;
+    while (map->index[h] != -1)
+      h = (h + 1) & mask;
+    map->pids[h] = pids[i];
+    map->index[h] = i;
+  }
+}
+
+static void pid_map_free(pid_map_t *map) {
+  free(map->pids);
+  free(map->index);
+}
+
+/**
+ * build_tree — indexes the snapshot by PID and links every process to its
+ * parent in one pass, keeping children in /proc order.
+ *
+ * @param tree  Tree to fill; release with free_tree().
+ * @param t     Process table.
+ */
+static void build_tree(proc_tree_t *tree, const proc_snapshot_t *t) {
+  int count = t->count;
+  pid_map_build(&tree->map, t->pid, count);
+
+  tree->first_child = malloc(sizeof(int) * (count ? count : 1));
+  tree->next_sibling = malloc(sizeof(int) * (count ? count : 1));
+  memset(tree->first_child, -1, sizeof(int) * count);
+  memset(tree->next_sibling, -1, sizeof(int) * count);
+
+  // walk backwards and prepend, so siblings end up in /proc order
+  for (int i = count - 1; i >= 0; i--) {
+    if (t->ppid[i] == t->pid[i])
+      continue;
+    int parent = pid_map_find(&tree->map, t->ppid[i]);
+    if (parent < 0)
+      continue;
+    tree->next_sibling[i] = tree->first_child[parent];
+    tree->first_child[parent] = i;
+  }
+}
+
+static void free_tree(proc_tree_t *tree) {
+  pid_map_free(&tree->map);
+  free(tree->first_child);
+  free(tree->next_sibling);
 }
 
 /* ─── Tree Rendering ─── */
 
+// Growable output buffer the tree is rendered into
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} tree_buf_t;
+
+static void buf_append(tree_buf_t *b, const char *s, size_t n) {
+  if (b->len + n + 1 > b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 65536;
+    while (b->len + n + 1 > b->cap)
+      b->cap *= 2;
+    b->data = realloc(b->data, b->cap);
+  }
+  memcpy(b->data + b->len, s, n);
+  b->len += n;
+  b->data[b->len] = '\0';
+}
+
+static void buf_puts(tree_buf_t *b, const char *s) {
+  buf_append(b, s, strlen(s));
+}
+
+static void buf_printf(tree_buf_t *b, const char *fmt, ...) {
+  char line[512];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (n < 0)
+    return;
+  if ((size_t)n >= sizeof(line))
+    n = sizeof(line) - 1;
+  buf_append(b, line, n);
+}
+
+/**
+ * buf_write — flushes the whole buffer to a file descriptor, retrying on
+ * short writes, so a rendered tree leaves in one write() call.
+ *
+ * @param b   Output buffer.
+ * @param fd  Destination.
+ */
+static void buf_write(const tree_buf_t *b, int fd) {
+  size_t done = 0;
+  while (done < b->len) {
+    ssize_t n = write(fd, b->data + done, b->len - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("process_tree: write");
+      return;
+    }
+    done += n;
+  }
+}
+
+/**
+ * buf_json_string — appends a JSON string literal.
+ *
+ * @param b  Output buffer.
+ * @param s  Raw string.
+ */
+static void buf_json_string(tree_buf_t *b, const char *s) {
+  buf_append(b, "\"", 1);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      char esc[2] = {'\\', (char)c};
+      buf_append(b, esc, 2);
+    } else if (c < 0x20) {
+      buf_printf(b, "\\u%04x", c);
+    } else {
+      buf_append(b, (const char *)&c, 1);
+    }
+  }
+  buf_append(b, "\"", 1);
+}
+
+typedef enum {
+  TREE_TEXT, // box-drawing tree
+  TREE_FLAT, // pid ppid depth name, tab separated, in tree order
+  TREE_JSON, // nested objects with a "children" array
+} tree_format_t;
+
+// Optional per-process columns (--columns)
+enum {
+  COL_STATE = 1 << 0,
+  COL_RSS = 1 << 1,
+  COL_CPU = 1 << 2,
+  COL_THREADS = 1 << 3,
+};
+
+typedef struct {
+  tree_format_t format;
+  bool color;       // ANSI colors in TREE_TEXT output
+  unsigned columns; // COL_* bits
+  bool totals;      // subtree aggregates (--totals)
+} render_opts_t;
+
+// Subtree aggregates, indexed like the process table
+typedef struct {
+  long *rss_kb;
+  unsigned long long *cpu_ticks;
+  int *procs;
+} proc_totals_t;
+
+/**
+ * compute_totals — sums RSS, CPU time and process count over every
+ * subtree below root. The walk records nodes in pre-order; sweeping that
+ * order backwards visits children before parents, so each node is added
+ * into its parent exactly once.
+ *
+ * @param tot   Output (release with free_totals()).
+ * @param root  Index of the root process.
+ * @param tree  Parent / child links.
+ * @param t     Process table.
+ */
+static void compute_totals(proc_totals_t *tot, int root,
+                           const proc_tree_t *tree, const proc_snapshot_t *t) {
+  tot->rss_kb = malloc(sizeof(long) * t->count);
+  tot->cpu_ticks = malloc(sizeof(unsigned long long) * t->count);
+  tot->procs = malloc(sizeof(int) * t->count);
+  int *order = malloc(sizeof(int) * t->count);
+  int *parent = malloc(sizeof(int) * t->count);
+
+  // Pre-order walk; order[] doubles as the stack of pending siblings
+  int n = 0;
+  order[n] = root;
+  parent[n++] = -1;
+  for (int k = 0; k < n; k++) {
+    int node = order[k];
+    tot->rss_kb[node] = t->rss_kb[node];
+    tot->cpu_ticks[node] = t->cpu_ticks[node];
+    tot->procs[node] = 1;
+    for (int c = tree->first_child[node]; c != -1 && n < t->count;
+         c = tree->next_sibling[c]) {
+      order[n] = c;
+      parent[n++] = node;
+    }
+  }
+
+  for (int k = n - 1; k > 0; k--) {
+    int node = order[k], up = parent[k];
+    tot->rss_kb[up] += tot->rss_kb[node];
+    tot->cpu_ticks[up] += tot->cpu_ticks[node];
+    tot->procs[up] += tot->procs[node];
+  }
+  free(order);
+  free(parent);
+}
+
+static void free_totals(proc_totals_t *tot) {
+  free(tot->rss_kb);
+  free(tot->cpu_ticks);
+  free(tot->procs);
+}
+
+/**
+ * buf_size_kb — appends a size in KiB in human-readable form.
+ *
+ * @param b   Output buffer.
+ * @param kb  Size in KiB.
+ */
+static void buf_size_kb(tree_buf_t *b, long kb) {
+  if (kb < 1024)
+    buf_printf(b, "%ldK", kb);
+  else if (kb < 1024L * 1024)
+    buf_printf(b, "%.1fM", kb / 1024.0);
+  else
+    buf_printf(b, "%.1fG", kb / (1024.0 * 1024));
+}
+
+static double ticks_to_sec(unsigned long long ticks) {
+  static long hz;
+  if (hz == 0)
+    hz = sysconf(_SC_CLK_TCK);
+  return (double)ticks / (double)hz;
+}
+
+/**
+ * render_columns — appends the requested columns of one process in the
+ * given output format.
+ *
+ * @param out   Output buffer.
+ * @param opts  Output format and columns.
+ * @param t     Process table.
+ * @param tot   Subtree totals, or NULL.
+ * @param node  Table index of the process.
+ */
+static void render_columns(tree_buf_t *out, const render_opts_t *opts,
+                           const proc_snapshot_t *t, const proc_totals_t *tot,
+                           int node) {
+  unsigned cols = opts->columns;
+  switch (opts->format) {
+  case TREE_TEXT:
+    if (cols == 0 && tot == NULL)
+      return;
+    buf_puts(out, opts->color ? " \033[2m[" : " [");
+    const char *sep = "";
+    if (cols & COL_STATE) {
+      buf_printf(out, "%c", t->state[node]);
+      sep = " ";
+    }
+    if (cols & COL_RSS) {
+      buf_printf(out, "%srss=", sep);
+      buf_size_kb(out, t->rss_kb[node]);
+      sep = " ";
+    }
+    if (cols & COL_CPU) {
+      buf_printf(out, "%scpu=%.2fs", sep, ticks_to_sec(t->cpu_ticks[node]));
+      sep = " ";
+    }
+    if (cols & COL_THREADS) {
+      buf_printf(out, "%sthr=%d", sep, t->threads[node]);
+      sep = " ";
+    }
+    if (tot != NULL && tot->procs[node] > 1) {
+      buf_printf(out, "%stotal: %d procs rss=", sep, tot->procs[node]);
+      buf_size_kb(out, tot->rss_kb[node]);
+      buf_printf(out, " cpu=%.2fs", ticks_to_sec(tot->cpu_ticks[node]));
+    }
+    buf_puts(out, opts->color ? "]\033[0m" : "]");
+    break;
+
+  case TREE_FLAT:
+    if (cols & COL_STATE)
+      buf_printf(out, "%c\t", t->state[node]);
+    if (cols & COL_RSS)
+      buf_printf(out, "%ld\t", t->rss_kb[node]);
+    if (cols & COL_CPU)
+      buf_printf(out, "%.2f\t", ticks_to_sec(t->cpu_ticks[node]));
+    if (cols & COL_THREADS)
+      buf_printf(out, "%d\t", t->threads[node]);
+    if (tot != NULL)
+      buf_printf(out, "%d\t%ld\t%.2f\t", tot->procs[node], tot->rss_kb[node],
+                 ticks_to_sec(tot->cpu_ticks[node]));
+    break;
+
+  case TREE_JSON:
+    if (cols & COL_STATE)
+      buf_printf(out, ",\"state\":\"%c\"", t->state[node]);
+    if (cols & COL_RSS)
+      buf_printf(out, ",\"rss_kb\":%ld", t->rss_kb[node]);
+    if (cols & COL_CPU)
+      buf_printf(out, ",\"cpu_s\":%.2f", ticks_to_sec(t->cpu_ticks[node]));
+    if (cols & COL_THREADS)
+      buf_printf(out, ",\"threads\":%d", t->threads[node]);
+    if (tot != NULL)
+      buf_printf(out,
+                 ",\"total_procs\":%d,\"total_rss_kb\":%ld,"
+                 "\"total_cpu_s\":%.2f",
+                 tot->procs[node], tot->rss_kb[node],
+                 ticks_to_sec(tot->cpu_ticks[node]));
+    break;
+  }
+}
+
+/**
+ * render_node — emits one process when the walk reaches it.
+ *
+ * @param out      Output buffer.
+ * @param opts     Output format.
+ * @param t        Process table.
+ * @param tot      Subtree totals, or NULL.
+ * @param node     Table index of the process.
+ * @param depth    Depth below the root.
+ * @param is_last  is_last[d]: the ancestor at depth d + 1 is a last child.
+ * @param has_children  Whether the walk will descend into the node.
+ */
+static void render_node(tree_buf_t *out, const render_opts_t *opts,
+                        const proc_snapshot_t *t, const proc_totals_t *tot,
+                        int node, int depth, const int *is_last,
+                        bool has_children) {
+  switch (opts->format) {
+  case TREE_TEXT:
+    // Indentation: │ or space for each level
+    for (int i = 0; i < depth - 1; i++) {
+      if (is_last[i])
+        buf_puts(out, "    ");
+      else
+        buf_puts(out, "│   ");
+    }
+
+    // Connection character
+    if (depth > 0) {
+      if (is_last[depth - 1])
+        buf_puts(out, "└── ");
+      else
+        buf_puts(out, "├── ");
+    }
+
+    // Process info
+    if (opts->color)
+      buf_printf(out, "\033[1;36m%s\033[0m (\033[33m%d\033[0m)",
+                 proc_name(t, node), t->pid[node]);
+    else
+      buf_printf(out, "%s (%d)", proc_name(t, node), t->pid[node]);
+    render_columns(out, opts, t, tot, node);
+    buf_puts(out, "\n");
+    break;
+
+  case TREE_FLAT:
+    // name stays last since it is free-form
+    buf_printf(out, "%d\t%d\t%d\t", t->pid[node], t->ppid[node], depth);
+    render_columns(out, opts, t, tot, node);
+    buf_printf(out, "%s\n", proc_name(t, node));
+    break;
+
+  case TREE_JSON:
+    buf_printf(out, "{\"pid\":%d,\"ppid\":%d,\"name\":", t->pid[node],
+               t->ppid[node]);
+    buf_json_string(out, proc_name(t, node));
+    render_columns(out, opts, t, tot, node);
+    buf_puts(out, has_children ? ",\"children\":[" : "}");
+    break;
+  }
+}
+
 // Draws the tree using Unicode box-drawing characters
 /**
- * print_tree — main entry point for the print_tree command.
+ * render_tree — renders the subtree below root with an iterative
+ * depth-first walk, so deep trees cannot exhaust the stack.
  *
- * @param root_pid  PID of the root process.
- * @param depth     Current depth of the tree.
- * @param is_last   Array of booleans indicating if a node is the last child.
- * @param procs     Array of proc_info_t structures.
- * @param count     Number of processes in the array.
- */
-static void print_tree(int root_pid, int depth, int *is_last,
-                       proc_info_t *procs, int count) {
-  // Find the root node
-  proc_info_t *root = NULL;
-  for (int i = 0; i < count; i++) {
-    if (procs[i].pid == root_pid) {
-      root = &procs[i];
+ * @param out   Output buffer.
+ * @param opts  Output format.
+ * @param root  Index of the root process.
+ * @param tree  Parent / child links.
+ * @param t     Process table.
+ */
+static void render_tree(tree_buf_t *out, const render_opts_t *opts, int root,
+                        const proc_tree_t *tree, const proc_snapshot_t *t) {
+  proc_totals_t totals, *tot = NULL;
+  if (opts->totals) {
+    compute_totals(&totals, root, tree, t);
+    tot = &totals;
+  }
+  int cap = 64;
+  int *ancestors = malloc(sizeof(int) * cap); // ancestors[d] = node at depth d
+  int *is_last = malloc(sizeof(int) * cap);   // last child at depth d + 1?
+  int node = root;
+  int depth = 0;
+  bool json = opts->format == TREE_JSON;
+
+  while (1) {
+    bool descend = tree->first_child[node] != -1 && depth < t->count;
+    render_node(out, opts, t, tot, node, depth, is_last, descend);
+
+    // Descend into the first child
+    if (descend) {
+      if (depth + 1 >= cap) {
+        cap *= 2;
+        ancestors = realloc(ancestors, sizeof(int) * cap);
+        is_last = realloc(is_last, sizeof(int) * cap);
+      }
+      ancestors[depth++] = node;
+      node = tree->first_child[node];
+      is_last[depth - 1] = tree->next_sibling[node] == -1;
+      continue;
+    }
+
+    // Otherwise climb up until there is a next sibling
+    while (depth > 0 && tree->next_sibling[node] == -1) {
+      node = ancestors[--depth];
+      if (json)
+        buf_puts(out, "]}");
+    }
+    if (depth == 0)
       break;
+    if (json)
+      buf_puts(out, ",");
+    node = tree->next_sibling[node];
+    is_last[depth - 1] = tree->next_sibling[node] == -1;
+  }
+  if (json)
+    buf_puts(out, "\n");
+
+  free(ancestors);
+  free(is_last);
+  if (tot != NULL)
+    free_totals(tot);
+}
+
+/* ─── Watch Mode ─── */
+
+static volatile sig_atomic_t watch_stop; // set by Ctrl-C during --watch
+
+static void watch_sigint(int sig) {
+  (void)sig;
+  watch_stop = 1;
+}
+
+/**
+ * proc_snapshot_update — rescans /proc incrementally. Only the directory
+ * listing is read for every process; stat files are read just for new
+ * PIDs and for survivors whose parent vanished (they were re-parented).
+ * Everything else, including the name, is reused from prev.
+ *
+ * @param prev     Previous snapshot (released by this call).
+ * @param changed  Set to 1 if any process appeared, vanished or moved.
+ * @return         New snapshot, or NULL if /proc could not be read.
+ */
+proc_snapshot_t *proc_snapshot_update(proc_snapshot_t *prev, int *changed) {
+  *changed = 0;
+  DIR *dir = opendir("/proc");
+  if (!dir) {
+    perror("opendir /proc");
+    proc_snapshot_free(prev);
+    return NULL;
+  }
+  int proc_fd = dirfd(dir);
+  int npids;
+  int *pids = list_proc_pids(dir, &npids);
+
+  pid_map_t cur_map, prev_map;
+  pid_map_build(&cur_map, pids, npids);
+  pid_map_build(&prev_map, prev->pid, prev->count);
+
+  proc_snapshot_t *t = calloc(1, sizeof(proc_snapshot_t));
+  long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+  proc_stat_t st;
+  for (int i = 0; i < npids; i++) {
+    int old = pid_map_find(&prev_map, pids[i]);
+    if (old >= 0 && (prev->ppid[old] == 0 ||
+                     pid_map_find(&cur_map, prev->ppid[old]) >= 0)) {
+      proc_table_copy(t, prev, old);
+      continue;
     }
+    *changed = 1; // new PID, or its parent is gone
+    if (proc_read_stat(proc_fd, pids[i], page_kb, &st) == 0)
+      proc_table_add(t, &st);
   }
-  if (!root)
-    return;
+  if (t->count != prev->count)
+    *changed = 1; // something vanished
 
-  // Indentation: │ or space for each level
-  for (int i = 0; i < depth; i++) {
-    if (is_last[i])
-      printf("    ");
-    else
-      printf("│   ");
+  pid_map_free(&cur_map);
+  pid_map_free(&prev_map);
+  free(pids);
+  closedir(dir);
+  proc_snapshot_free(prev);
+  return t;
+}
+
+// Line starts of one rendered frame
+typedef struct {
+  tree_buf_t text;
+  size_t *start; // start[count] is the end of the last line
+  int count;
+  int cap;
+} watch_frame_t;
+
+static void frame_split(watch_frame_t *f, int max_lines) {
+  f->count = 0;
+  size_t pos = 0;
+  while (1) {
+    if (f->count + 1 >= f->cap) {
+      f->cap = f->cap ? f->cap * 2 : 256;
+      f->start = realloc(f->start, sizeof(size_t) * f->cap);
+    }
+    if (pos >= f->text.len || f->count >= max_lines)
+      break;
+    f->start[f->count++] = pos;
+    char *nl = memchr(f->text.data + pos, '\n', f->text.len - pos);
+    pos = nl ? (size_t)(nl - f->text.data) + 1 : f->text.len;
   }
+  f->start[f->count] = pos;
+}
 
-  // Connection character
-  if (depth > 0) {
-    if (is_last[depth - 1])
-      printf("└── ");
-    else
-      printf("├── ");
+static size_t frame_line_len(const watch_frame_t *f, int i) {
+  size_t len = f->start[i + 1] - f->start[i];
+  if (len > 0 && f->text.data[f->start[i] + len - 1] == '\n')
+    len--;
+  return len;
+}
+
+/**
+ * watch_tree — redraws the tree every interval until Ctrl-C. On a
+ * terminal only the lines that differ from the previous frame are
+ * rewritten, using cursor positioning; otherwise full frames are printed.
+ *
+ * @param root_pid  PID of the root process.
+ * @param jobs      Threads for full scans.
+ * @param interval  Seconds between rescans.
+ * @param opts      Output format (always TREE_TEXT).
+ */
+static void watch_tree(int root_pid, int jobs, double interval,
+                       const render_opts_t *opts) {
+  bool tty = isatty(STDOUT_FILENO);
+  struct sigaction sa, old_sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = watch_sigint; // no SA_RESTART: interrupt the sleep
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_sa);
+  watch_stop = 0;
+
+  watch_frame_t prev = {{NULL, 0, 0}, NULL, 0, 0};
+  watch_frame_t cur = {{NULL, 0, 0}, NULL, 0, 0};
+  tree_buf_t out = {NULL, 0, 0};
+  proc_snapshot_t *procs = proc_snapshot_take(jobs);
+  int changed = 1;
+
+  fflush(stdout);
+  if (tty) { // clear the screen, hide the cursor, clip long lines
+    out.len = 0;
+    buf_puts(&out, "\033[H\033[2J\033[?25l\033[?7l");
+    buf_write(&out, STDOUT_FILENO);
   }
 
-  // Process info
-  printf("\033[1;36m%s\033[0m (\033[33m%d\033[0m)\n", root->name, root->pid);
+  while (procs != NULL && !watch_stop) {
+    if (changed) {
+      proc_tree_t tree;
+      build_tree(&tree, procs);
+      int root = pid_map_find(&tree.map, root_pid);
 
-  // Find children
-  int children[MAX_PROCS];
-  int child_count = 0;
-  for (int i = 0; i < count; i++) {
-    if (procs[i].ppid == root_pid && procs[i].pid != root_pid)
-      children[child_count++] = procs[i].pid;
+      cur.text.len = 0;
+      buf_puts(&cur.text, opts->color
+                              ? "\033[1;35m─── Process Tree ───\033[0m"
+                              : "─── Process Tree ───");
+      buf_printf(&cur.text, "  every %gs, %d processes, Ctrl-C to quit\n",
+                 interval, procs->count);
+      if (root >= 0)
+        render_tree(&cur.text, opts, root, &tree, procs);
+      else
+        buf_printf(&cur.text, "process_tree: PID %d exited\n", root_pid);
+      free_tree(&tree);
+
+      int rows = 0;
+      struct winsize ws;
+      if (tty && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+        rows = ws.ws_row - 1;
+      if (rows <= 0)
+        rows = 1 << 30;
+      frame_split(&cur, rows);
+
+      out.len = 0;
+      if (tty) {
+        for (int i = 0; i < cur.count; i++) {
+          size_t len = frame_line_len(&cur, i);
+          if (i < prev.count && len == frame_line_len(&prev, i) &&
+              memcmp(cur.text.data + cur.start[i],
+                     prev.text.data + prev.start[i], len) == 0)
+            continue; // unchanged line stays on screen
+          buf_printf(&out, "\033[%d;1H", i + 1);
+          buf_append(&out, cur.text.data + cur.start[i], len);
+          buf_puts(&out, "\033[K");
+        }
+        if (cur.count < prev.count) // erase lines of vanished processes
+          buf_printf(&out, "\033[%d;1H\033[J", cur.count + 1);
+        buf_printf(&out, "\033[%d;1H", cur.count + 1);
+      } else {
+        buf_append(&out, cur.text.data, cur.start[cur.count]);
+        buf_puts(&out, "\n");
+      }
+      buf_write(&out, STDOUT_FILENO);
+
+      watch_frame_t tmp = prev;
+      prev = cur;
+      cur = tmp;
+      if (root < 0)
+        break;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = (time_t)interval;
+    ts.tv_nsec = (long)((interval - (double)ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+    if (watch_stop)
+      break;
+    if (opts->columns != 0 || opts->totals) {
+      // resource columns change every tick: re-read every stat file and
+      // let the line diff keep the redraw small
+      proc_snapshot_free(procs);
+      procs = proc_snapshot_take(jobs);
+      changed = 1;
+    } else {
+      procs = proc_snapshot_update(procs, &changed);
+    }
   }
 
-  // Print children recursively
-  for (int i = 0; i < child_count; i++) {
-    is_last[depth] = (i == child_count - 1);
-    print_tree(children[i], depth + 1, is_last, procs, count);
+  if (tty) { // restore wrapping and cursor
+    out.len = 0;
+    buf_puts(&out, "\033[?7h\033[?25h");
+    buf_write(&out, STDOUT_FILENO);
   }
+  sigaction(SIGINT, &old_sa, NULL);
+
+  proc_snapshot_free(procs);
+  free(prev.text.data);
+  free(prev.start);
+  free(cur.text.data);
+  free(cur.start);
+  free(out.data);
 }
 
 /* ─── Main Entry Point ─── */
 
+/**
+ * parse_columns — parses a comma-separated --columns list.
+ *
+ * @param list  e.g. "rss,cpu" or "all".
+ * @param cols  COL_* bits, added to.
+ * @return      0 on success, -1 on an unknown column.
+ */
+static int parse_columns(const char *list, unsigned *cols) {
+  static const struct {
+    const char *name;
+    unsigned bit;
+  } names[] = {
+      {"state", COL_STATE},
+      {"rss", COL_RSS},
+      {"cpu", COL_CPU},
+      {"threads", COL_THREADS},
+      {"all", COL_STATE | COL_RSS | COL_CPU | COL_THREADS},
+  };
+  const char *p = list;
+  while (1) {
+    size_t len = strcspn(p, ",");
+    size_t k;
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++)
+      if (strlen(names[k].name) == len && strncmp(p, names[k].name, len) == 0)
+        break;
+    if (k == sizeof(names) / sizeof(names[0]))
+      return -1;
+    *cols |= names[k].bit;
+    if (p[len] == '\0')
+      return 0;
+    p += len + 1;
+  }
+}
+
 /**
  * handle_process_tree — main entry point for the handle_process_tree command.
  *
@@ -154,6 +1185,9 @@ static void print_tree(int root_pid, int depth, int *is_last,
 void handle_process_tree(int argc, char *argv[]) {
   int root_pid = 1; // default: full tree from PID 1
   int show_me = 0;
+  int jobs = 1; // threads for the /proc scan
+  double watch = 0; // --watch interval in seconds, 0 = print once
+  render_opts_t opts = {TREE_TEXT, true, 0, false};
 
   // Argument parsing
   for (int i = 1; i < argc; i++) {
@@ -162,6 +1196,51 @@ void handle_process_tree(int argc, char *argv[]) {
 
     if (strcmp(argv[i], "--me") == 0) {
       show_me = 1;
+    } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+      if (i + 1 < argc && argv[i + 1] != NULL) {
+        char *endptr;
+        long val = strtol(argv[++i], &endptr, 10);
+        if (*endptr != '\0' || val < 0 || val > 1024) {
+          fprintf(stderr, "process_tree: invalid thread count: '%s'\n",
+                  argv[i]);
+          return;
+        }
+        jobs = (int)val;
+      } else {
+        fprintf(stderr, "process_tree: -j requires a value\n");
+        return;
+      }
+    } else if (strcmp(argv[i], "--no-color") == 0) {
+      opts.color = false;
+    } else if (strcmp(argv[i], "--json") == 0) {
+      opts.format = TREE_JSON;
+    } else if (strcmp(argv[i], "--flat") == 0) {
+      opts.format = TREE_FLAT;
+    } else if (strcmp(argv[i], "--watch") == 0) {
+      watch = 2;
+      if (i + 1 < argc && argv[i + 1] != NULL && argv[i + 1][0] != '-') {
+        char *endptr;
+        double val = strtod(argv[i + 1], &endptr);
+        if (*endptr != '\0' || val < 0.05 || val > 86400) {
+          fprintf(stderr, "process_tree: invalid interval: '%s'\n",
+                  argv[i + 1]);
+          return;
+        }
+        watch = val;
+        i++;
+      }
+    } else if (strcmp(argv[i], "-o") == 0 ||
+               strcmp(argv[i], "--columns") == 0) {
+      if (i + 1 >= argc || argv[i + 1] == NULL) {
+        fprintf(stderr, "process_tree: %s requires a column list\n", argv[i]);
+        return;
+      }
+      if (parse_columns(argv[++i], &opts.columns) < 0) {
+        fprintf(stderr, "process_tree: invalid column list: '%s'\n", argv[i]);
+        return;
+      }
+    } else if (strcmp(argv[i], "--totals") == 0) {
+      opts.totals = true;
     } else if (strcmp(argv[i], "--pid") == 0) {
       if (i + 1 < argc && argv[i + 1] != NULL) {
         char *endptr;
@@ -179,43 +1258,51 @@ void handle_process_tree(int argc, char *argv[]) {
   }
 
   // --me: use the current shell's PID as root
-  // Note: since we run inside a fork, getppid() gives us the shell's PID
+  // Note: we may run inside the shell or in a forked pipeline stage, so the
+  // shell records its own PID instead of relying on getppid()
   if (show_me)
-    root_pid = getppid();
+    root_pid = shell_pid;
 
-  // Read all processes
-  proc_info_t *procs = malloc(sizeof(proc_info_t) * MAX_PROCS);
-  if (!procs) {
-    perror("malloc");
+  if (watch > 0) {
+    if (opts.format != TREE_TEXT) {
+      fprintf(stderr, "process_tree: --watch only draws the tree format\n");
+      return;
+    }
+    watch_tree(root_pid, jobs, watch, &opts);
     return;
   }
 
-  int count = read_all_procs(procs);
-  if (count == 0) {
+  // Read all processes
+  proc_snapshot_t *procs = proc_snapshot_take(jobs);
+  if (procs == NULL) {
     fprintf(stderr, "process_tree: failed to read processes\n");
-    free(procs);
     return;
   }
 
+  proc_tree_t tree;
+  build_tree(&tree, procs);
+
   // Check if the given root PID exists
-  int found = 0;
-  for (int i = 0; i < count; i++) {
-    if (procs[i].pid == root_pid) {
-      found = 1;
-      break;
-    }
-  }
-  if (!found) {
+  int root = pid_map_find(&tree.map, root_pid);
+  if (root < 0) {
     fprintf(stderr, "process_tree: PID %d not found\n", root_pid);
-    free(procs);
+    free_tree(&tree);
+    proc_snapshot_free(procs);
     return;
   }
 
-  // Draw the tree
-  int is_last[256] = {0};
-  printf("\n\033[1;35m─── Process Tree ───\033[0m\n\n");
-  print_tree(root_pid, 0, is_last, procs, count);
-  printf("\n");
+  // Draw the tree into one buffer and send it with a single write()
+  tree_buf_t out = {NULL, 0, 0};
+  if (opts.format == TREE_TEXT)
+    buf_puts(&out, opts.color ? "\n\033[1;35m─── Process Tree ───\033[0m\n\n"
+                              : "\n─── Process Tree ───\n\n");
+  render_tree(&out, &opts, root, &tree, procs);
+  if (opts.format == TREE_TEXT)
+    buf_puts(&out, "\n");
+  fflush(stdout);
+  buf_write(&out, STDOUT_FILENO);
 
-  free(procs);
+  free(out.data);
+  free_tree(&tree);
+  proc_snapshot_free(procs);
 }
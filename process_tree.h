@@ -0,0 +1,46 @@
+#ifndef PROCESS_TREE_H
+#define PROCESS_TREE_H
+
+// Interface of process_tree.c: the `process_tree` built-in and read-only
+// snapshots of /proc. A snapshot is opaque; its entries are read through
+// the accessors, with i in 0 .. proc_snapshot_count() - 1.
+
+typedef struct proc_snapshot proc_snapshot_t;
+
+/**
+ * proc_snapshot_take — reads every process currently in /proc.
+ *
+ * @param jobs  Threads used for the scan; 0 = one per CPU, 1 = serial.
+ * @return      New snapshot (release with proc_snapshot_free()), or NULL.
+ */
+proc_snapshot_t *proc_snapshot_take(int jobs);
+
+/**
+ * proc_snapshot_update — rescans /proc, reusing what is unchanged in prev.
+ *
+ * @param prev     Previous snapshot (released by this call).
+ * @param changed  Set to 1 if any process appeared, vanished or moved.
+ * @return         New snapshot, or NULL if /proc could not be read.
+ */
+proc_snapshot_t *proc_snapshot_update(proc_snapshot_t *prev, int *changed);
+
+void proc_snapshot_free(proc_snapshot_t *t);
+
+int proc_snapshot_count(const proc_snapshot_t *t);
+int proc_snapshot_pid(const proc_snapshot_t *t, int i);
+int proc_snapshot_ppid(const proc_snapshot_t *t, int i);
+const char *proc_snapshot_name(const proc_snapshot_t *t, int i);
+char proc_snapshot_state(const proc_snapshot_t *t, int i);
+long proc_snapshot_rss_kb(const proc_snapshot_t *t, int i);
+unsigned long long proc_snapshot_cpu_ticks(const proc_snapshot_t *t, int i);
+int proc_snapshot_threads(const proc_snapshot_t *t, int i);
+
+/**
+ * handle_process_tree — main entry point for the process_tree command.
+ *
+ * @param argc  Argument count (must be >= 1).
+ * @param argv  Argument vector.
+ */
+void handle_process_tree(int argc, char *argv[]);
+
+#endif
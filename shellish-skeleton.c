@@ -1,31 +1,34 @@
+#define _GNU_SOURCE // posix_spawn_file_actions_addtcsetpgrp_np
+
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <termios.h> // termios, TCSANOW, ECHO, ICANON
+#include <time.h>
 #include <unistd.h>
 
-// Signal handler to reap zombie background processes
-void sigchld_handler(int sig) {
-  (void)sig;
-  pid_t pid;
-  // Reap all finished child processes (non-blocking)
-  while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
-    printf("\nDONE [%d]\n", pid);
-  }
-}
-const char *sysname = "shellish";
+#include "process_tree.h"
+#include "shellish.h"
 
-// forward declaration for handle_cut (defined in my_cut.c)
-void handle_cut(int argc, char *argv[]);
-int chatroom(int argc, char *argv[]);
-void handle_process_tree(int argc, char *argv[]);
+const char *sysname = "shellish";
+pid_t shell_pid; // PID of the interactive shell, used by process_tree --me
+// Ctrl+C reached the interactive shell itself: at the prompt, or while a
+// built-in runs inside the shell process
+static volatile sig_atomic_t shell_interrupted;
 
 enum return_codes {
   SUCCESS = 0,
@@ -33,16 +36,6 @@ enum return_codes {
   UNKNOWN = 2,
 };
 
-struct command_t {
-  char *name;
-  bool background;
-  bool auto_complete;
-  int arg_count;
-  char **args;
-  char *redirects[3];     // in/out redirection
-  struct command_t *next; // for piping
-};
-
 /**
  * Prints a command struct
  * @param struct command_t *
@@ -51,7 +44,6 @@ void print_command(struct command_t *command) {
   int i = 0;
   printf("Command: <%s>\n", command->name);
   printf("\tIs Background: %s\n", command->background ? "yes" : "no");
-  printf("\tNeeds Auto-complete: %s\n", command->auto_complete ? "yes" : "no");
   printf("\tRedirects:\n");
   for (i = 0; i < 3; i++)
     printf("\t\t%d: %s\n", i,
@@ -65,26 +57,89 @@ void print_command(struct command_t *command) {
   }
 }
 
+/* ─── Parse Arena ─── */
+
+// Everything parse_command() allocates for one command line (the
+// command_t stages, names, args and redirect paths) comes from this bump
+// arena, and free_command() releases it all at once.
+#define ARENA_CHUNK 4096
+
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;
+  size_t used;
+  char data[];
+};
+
+struct arena {
+  struct arena_chunk *head; // current chunk, older ones follow
+  size_t total;             // bytes handed out since the last reset
+};
+
+static struct arena line_arena;
+
+/**
+ * Allocate zeroed memory from an arena
+ * @param  a    arena
+ * @param  size bytes
+ * @return      16-byte aligned memory, valid until arena_reset()
+ */
+static void *arena_alloc(struct arena *a, size_t size) {
+  size = (size + 15) & ~(size_t)15;
+  struct arena_chunk *c = a->head;
+  if (c == NULL || c->used + size > c->size) {
+    size_t cap = c ? c->size * 2 : ARENA_CHUNK;
+    while (cap < size)
+      cap *= 2;
+    c = malloc(sizeof(struct arena_chunk) + cap);
+    c->next = a->head;
+    c->size = cap;
+    c->used = 0;
+    a->head = c;
+  }
+  void *p = c->data + c->used;
+  c->used += size;
+  a->total += size;
+  memset(p, 0, size);
+  return p;
+}
+
 /**
- * Release allocated memory of a command
- * @param  command [description]
- * @return         [description]
+ * Release everything allocated from an arena in one step. If the line
+ * needed several chunks they are replaced by one chunk big enough for
+ * all of them, so the next line of the same size needs a single chunk.
+ * @param a arena
  */
-int free_command(struct command_t *command) {
-  if (command->arg_count) {
-    for (int i = 0; i < command->arg_count; ++i)
-      free(command->args[i]);
-    free(command->args);
-  }
-  for (int i = 0; i < 3; ++i)
-    if (command->redirects[i])
-      free(command->redirects[i]);
-  if (command->next) {
-    free_command(command->next);
-    command->next = NULL;
+static void arena_reset(struct arena *a) {
+  struct arena_chunk *c = a->head;
+  if (c != NULL && c->next != NULL) {
+    while (c != NULL) {
+      struct arena_chunk *next = c->next;
+      free(c);
+      c = next;
+    }
+    size_t cap = ARENA_CHUNK;
+    while (cap < a->total)
+      cap *= 2;
+    c = malloc(sizeof(struct arena_chunk) + cap);
+    c->next = NULL;
+    c->size = cap;
+    a->head = c;
   }
-  free(command->name);
-  free(command);
+  if (c != NULL)
+    c->used = 0;
+  a->total = 0;
+}
+
+/**
+ * Release allocated memory of a command. All stages of a command line
+ * live in the parse arena, so this frees the whole line at once.
+ * @param  command first stage of the command line
+ * @return         0
+ */
+int free_command(struct command_t *command) {
+  (void)command;
+  arena_reset(&line_arena);
   return 0;
 }
 
@@ -100,133 +155,705 @@ int show_prompt() {
   return 0;
 }
 
+/* ─── Profiling ─── */
+
+// shellish --profile: after every line, report the time the shell itself
+// spent parsing it, resolving commands in PATH and starting processes
+struct profile {
+  bool enabled;
+  long parse_ns, path_ns, spawn_ns;
+  int lookups, spawns;
+};
+
+static struct profile profile;
+
+/**
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+static long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 /**
- * Parse a command string into a command struct
- * @param  buf     [description]
- * @param  command [description]
- * @return         0
+ * Start timing a profiled step
+ * @return start time, or 0 when profiling is off
  */
-int parse_command(char *buf, struct command_t *command) {
-  const char *splitters = " \t"; // split at whitespace
-  int index, len;
-  len = strlen(buf);
-  while (len > 0 && strchr(splitters, buf[0]) != NULL) // trim left whitespace
-  {
-    buf++;
-    len--;
-  }
-  while (len > 0 && strchr(splitters, buf[len - 1]) != NULL)
-    buf[--len] = 0; // trim right whitespace
-
-  if (len > 0 && buf[len - 1] == '?') // auto-complete
-    command->auto_complete = true;
-  if (len > 0 && buf[len - 1] == '&') // background
-    command->background = true;
-
-  char *pch = strtok(buf, splitters);
-  if (pch == NULL) {
-    command->name = (char *)malloc(1);
-    command->name[0] = 0;
-  } else {
-    command->name = (char *)malloc(strlen(pch) + 1);
-    strcpy(command->name, pch);
+static long profile_start() { return profile.enabled ? now_ns() : 0; }
+
+/**
+ * Add the time since start to a profile counter
+ * @param counter counter in profile
+ * @param start   value from profile_start()
+ */
+static void profile_add(long *counter, long start) {
+  if (profile.enabled)
+    *counter += now_ns() - start;
+}
+
+/**
+ * Print the counters of the line that just ran to stderr and reset them
+ */
+static void profile_report() {
+  if (!profile.enabled)
+    return;
+  fprintf(stderr,
+          "[profile] parse %.1f us | path %.1f us (n=%d) | "
+          "spawn %.1f us (n=%d)\n",
+          profile.parse_ns / 1e3, profile.path_ns / 1e3, profile.lookups,
+          profile.spawn_ns / 1e3, profile.spawns);
+  profile = (struct profile){.enabled = true};
+}
+
+/* ─── Tokenizer ─── */
+
+enum token_kind {
+  TOK_WORD,         // command name or argument, quotes already removed
+  TOK_PIPE,         // |
+  TOK_AMP,          // &
+  TOK_REDIR_IN,     // <
+  TOK_REDIR_OUT,    // >
+  TOK_REDIR_APPEND, // >>
+};
+
+struct token {
+  enum token_kind kind;
+  char *text; // TOK_WORD only
+};
+
+/**
+ * Split a command line into a flat token array in one left-to-right pass.
+ * Words may mix unquoted, '...' (literal) and "..." (\" and \\ escapes)
+ * parts; a backslash outside quotes escapes the next character. |, &, <,
+ * > and >> are tokens of their own and need no surrounding spaces. A #
+ * at the start of a word begins a comment. The tokenizer keeps no state
+ * between calls.
+ * @param  buf    command line
+ * @param  a      arena for the tokens and the word text
+ * @param  tokens set to the token array
+ * @return        number of tokens
+ */
+static int tokenize(const char *buf, struct arena *a, struct token **tokens) {
+  size_t len = strlen(buf);
+  // every token uses at least one input byte, and the words together
+  // need at most one byte per input byte plus one NUL per word
+  struct token *tok = arena_alloc(a, sizeof(struct token) * (len + 1));
+  char *text = arena_alloc(a, 2 * len + 1);
+  int count = 0;
+
+  const char *p = buf;
+  while (*p) {
+    if (*p == ' ' || *p == '\t') {
+      p++;
+      continue;
+    }
+    if (*p == '#') // comment (also skips a script's #! line)
+      break;
+
+    struct token *t = &tok[count++];
+    t->text = NULL;
+    if (*p == '|') {
+      t->kind = TOK_PIPE;
+      p++;
+    } else if (*p == '&') {
+      t->kind = TOK_AMP;
+      p++;
+    } else if (*p == '<') {
+      t->kind = TOK_REDIR_IN;
+      p++;
+    } else if (*p == '>') {
+      t->kind = p[1] == '>' ? TOK_REDIR_APPEND : TOK_REDIR_OUT;
+      p += p[1] == '>' ? 2 : 1;
+    } else {
+      t->kind = TOK_WORD;
+      t->text = text;
+      while (*p && !strchr(" \t|&<>", *p)) {
+        if (*p == '\'') { // literal up to the closing quote
+          for (p++; *p && *p != '\''; p++)
+            *text++ = *p;
+          if (*p)
+            p++;
+        } else if (*p == '"') {
+          for (p++; *p && *p != '"'; p++) {
+            if (*p == '\\' && (p[1] == '"' || p[1] == '\\'))
+              p++;
+            *text++ = *p;
+          }
+          if (*p)
+            p++;
+        } else {
+          if (*p == '\\' && p[1])
+            p++;
+          *text++ = *p++;
+        }
+      }
+      *text++ = '\0';
+    }
+  }
+
+  *tokens = tok;
+  return count;
+}
+
+/**
+ * Source text of an operator token, for error messages
+ * @param  t token
+ * @return   operator text
+ */
+static const char *token_text(const struct token *t) {
+  switch (t->kind) {
+  case TOK_WORD:
+    return t->text;
+  case TOK_PIPE:
+    return "|";
+  case TOK_AMP:
+    return "&";
+  case TOK_REDIR_IN:
+    return "<";
+  case TOK_REDIR_OUT:
+    return ">";
+  case TOK_REDIR_APPEND:
+    return ">>";
   }
+  return "";
+}
+
+/**
+ * Report a syntax error and leave an empty command behind
+ * @param  command first stage
+ * @param  near    text of the offending token
+ * @return         -1
+ */
+static int parse_error(struct command_t *command, const char *near) {
+  printf("-%s: syntax error near unexpected token `%s'\n", sysname, near);
+  command->name = "";
+  command->args[0] = NULL;
+  command->arg_count = 1;
+  command->next = NULL;
+  return -1;
+}
+
+/**
+ * Parse a command string into a command struct. The line is tokenized
+ * once and the tokens are consumed left to right, one pipeline stage at a
+ * time, so the cost is linear in the line length for any number of stages.
+ * @param  buf     command line
+ * @param  command zeroed first stage, filled in
+ * @return         0, or -1 on a syntax error (command->name is then "")
+ */
+int parse_command(char *buf, struct command_t *command) {
+  struct token *tok;
+  int count = tokenize(buf, &line_arena, &tok);
 
-  command->args = (char **)malloc(sizeof(char *));
+  // a trailing & puts the whole pipeline in the background
+  bool background = count > 0 && tok[count - 1].kind == TOK_AMP;
 
-  int redirect_index;
-  int arg_index = 0;
-  char temp_buf[1024], *arg;
+  struct command_t *c = command;
+  int i = 0;
   while (1) {
-    // tokenize input on splitters
-    pch = strtok(NULL, splitters);
-    if (!pch)
+    c->background = background;
+
+    // words of this stage (an upper bound: redirect targets are
+    // counted too), to size args once
+    int words = 0;
+    for (int j = i; j < count && tok[j].kind != TOK_PIPE; j++)
+      if (tok[j].kind == TOK_WORD)
+        words++;
+
+    // args[0] is the name, args[arg_count - 1] the terminating NULL
+    c->args = arena_alloc(&line_arena, sizeof(char *) * (words + 2));
+    int arg_index = 0;
+    for (; i < count && tok[i].kind != TOK_PIPE; i++) {
+      int redirect_index = -1;
+      switch (tok[i].kind) {
+      case TOK_WORD:
+        c->args[arg_index++] = tok[i].text;
+        break;
+      case TOK_AMP:
+        break; // handled above
+      case TOK_REDIR_IN:
+        redirect_index = 0;
+        break;
+      case TOK_REDIR_OUT:
+        redirect_index = 1;
+        break;
+      case TOK_REDIR_APPEND:
+        redirect_index = 2;
+        break;
+      case TOK_PIPE:
+        break;
+      }
+      if (redirect_index == -1)
+        continue;
+      if (i + 1 >= count)
+        return parse_error(command, "newline");
+      if (tok[i + 1].kind != TOK_WORD)
+        return parse_error(command, token_text(&tok[i + 1]));
+      c->redirects[redirect_index] = tok[++i].text;
+    }
+    // a | needs a command on both sides: `| a`, `a |` and `a || b` are
+    // errors, while an empty line is not
+    if (arg_index == 0 && (i < count || c != command)) {
+      const char *near = background ? "&" : "newline";
+      return parse_error(command, i < count ? "|" : near);
+    }
+    c->name = arg_index > 0 ? c->args[0] : "";
+    if (arg_index == 0)
+      c->args[arg_index++] = c->name;
+    c->args[arg_index] = NULL;
+    c->arg_count = arg_index + 1;
+
+    if (i >= count)
       break;
-    arg = temp_buf;
-    strcpy(arg, pch);
-    len = strlen(arg);
+    i++; // skip the |
+    c->next = arena_alloc(&line_arena, sizeof(struct command_t));
+    c = c->next;
+  }
+  return 0;
+}
 
-    if (len == 0)
-      continue; // empty arg, go for next
-    while (len > 0 && strchr(splitters, arg[0]) != NULL) // trim left whitespace
-    {
-      arg++;
-      len--;
-    }
-    while (len > 0 && strchr(splitters, arg[len - 1]) != NULL)
-      arg[--len] = 0; // trim right whitespace
-    if (len == 0)
-      continue; // empty arg, go for next
-
-    // piping to another command
-    if (strcmp(arg, "|") == 0) {
-      struct command_t *c =
-          (struct command_t *)malloc(sizeof(struct command_t));
-      int l = strlen(pch);
-      pch[l] = splitters[0]; // restore strtok termination
-      index = 1;
-      while (pch[index] == ' ' || pch[index] == '\t')
-        index++; // skip whitespaces
-
-      parse_command(pch + index, c);
-      pch[l] = 0; // put back strtok termination
-      command->next = c;
-      continue;
+/* ─── History ─── */
+
+// Interactive history: a ring of the last HISTORY_SIZE lines, backed by an
+// append-only file ($HISTFILE, or ~/.shellish_history) that every accepted
+// line is written to at once. The file is only read when the history is
+// first used (up arrow, Ctrl+R, `history`), so startup does not depend on
+// its size: it is mapped privately and its newlines are turned into NULs
+// in place, so loaded lines point straight into the mapping. The file is
+// cut back to its last HISTORY_SIZE lines, by writing them to a temporary
+// file that replaces it, once the lines beyond those take more space than
+// the kept ones: when it is loaded, and after every HISTORY_SIZE lines
+// appended. It therefore stays below about twice the ring's size.
+//
+// Searches go through a trigram index that maps every trigram to the
+// ascending ids of the lines containing it. A query walks the shortest
+// posting list of its trigrams from the current position and checks only
+// those candidates. Queries shorter than a trigram match so many lines
+// that a plain walk over the ring finds one within a few entries; its
+// worst case, a short query that matches nothing, is one pass over the
+// HISTORY_SIZE lines of the ring. When
+// the ring drops its oldest line, that line's id is at the head of each
+// of its trigrams' lists and is cut off there, so the index only ever
+// holds the ids of lines still in the ring.
+#define HISTORY_SIZE 100000
+#define HISTORY_BUCKETS_MIN 4096 // initial trigram table size, power of 2
+
+struct history_posting {
+  uint32_t trigram; // 0 marks a free bucket: trigrams contain no NUL
+  int *ids;         // ascending; the live ones are ids[head .. count - 1]
+  int head, count, cap;
+};
+
+struct history {
+  bool loaded;
+  int fd;           // append-only file, -1 until opened or if unavailable
+  char *map;        // private mapping of the file at load time
+  size_t map_size;
+  char **lines;     // line with id i is lines[i % HISTORY_SIZE]
+  int first, count; // valid ids are first .. count - 1
+  struct history_posting *index;
+  int index_cap, index_used;
+  char *last; // most recent line, so repeats are stored once
+  int appended; // lines written since the file was last trimmed
+};
+
+static struct history history = {.fd = -1};
+
+/**
+ * @return path of the history file, or NULL if there is no home directory
+ */
+static const char *history_path() {
+  static char path[1024];
+  const char *env = getenv("HISTFILE");
+  if (env != NULL && *env)
+    return env;
+  const char *home = getenv("HOME");
+  if (home == NULL || !*home)
+    return NULL;
+  snprintf(path, sizeof(path), "%s/.%s_history", home, sysname);
+  return path;
+}
+
+/**
+ * @param  p at least three characters
+ * @return   the trigram starting at p as one key
+ */
+static uint32_t history_trigram(const char *p) {
+  return (uint32_t)(unsigned char)p[0] << 16 |
+         (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+/**
+ * Find the posting list of a trigram in the open-addressing table
+ * @param  trigram key
+ * @param  create  add an empty list if there is none
+ * @return         posting list, or NULL if absent and !create
+ */
+static struct history_posting *history_posting(uint32_t trigram,
+                                               bool create) {
+  if (create && 2 * (history.index_used + 1) > history.index_cap) {
+    // grow to keep the table at most half full
+    int old_cap = history.index_cap;
+    struct history_posting *old = history.index;
+    history.index_cap = old_cap ? 2 * old_cap : HISTORY_BUCKETS_MIN;
+    history.index = calloc(history.index_cap, sizeof(*history.index));
+    for (int i = 0; i < old_cap; i++) {
+      if (old[i].trigram == 0)
+        continue;
+      unsigned b = (old[i].trigram * 2654435761u) & (history.index_cap - 1);
+      while (history.index[b].trigram != 0)
+        b = (b + 1) & (history.index_cap - 1);
+      history.index[b] = old[i];
     }
+    free(old);
+  }
+  if (history.index_cap == 0)
+    return NULL;
+
+  unsigned b = (trigram * 2654435761u) & (history.index_cap - 1);
+  while (history.index[b].trigram != 0) {
+    if (history.index[b].trigram == trigram)
+      return &history.index[b];
+    b = (b + 1) & (history.index_cap - 1);
+  }
+  if (!create)
+    return NULL;
+  history.index[b].trigram = trigram;
+  history.index_used++;
+  return &history.index[b];
+}
 
-    // background process
-    if (strcmp(arg, "&") == 0)
-      continue; // handled before
+/**
+ * Drop the oldest entry and cut its id off the head of its posting lists
+ */
+static void history_evict() {
+  int id = history.first++;
+  char *old = history.lines[id % HISTORY_SIZE];
+  size_t len = strlen(old);
+  for (size_t i = 0; i + 3 <= len; i++) {
+    struct history_posting *p =
+        history_posting(history_trigram(old + i), false);
+    if (p == NULL || p->head == p->count || p->ids[p->head] != id)
+      continue; // trigram repeated within the line
+    if (++p->head == p->count) { // nothing left
+      free(p->ids);
+      p->ids = NULL;
+      p->head = p->count = p->cap = 0;
+    } else if (2 * p->head >= p->count) { // mostly dead: compact
+      p->count -= p->head;
+      memmove(p->ids, p->ids + p->head, sizeof(int) * p->count);
+      p->head = 0;
+    }
+  }
+  if (old < history.map || old >= history.map + history.map_size)
+    free(old);
+}
 
-    // handle input redirection
-    redirect_index = -1;
-    if (arg[0] == '<')
-      redirect_index = 0;
-    if (arg[0] == '>') {
-      if (len > 1 && arg[1] == '>') {
-        redirect_index = 2;
-        arg++;
-        len--;
-      } else
-        redirect_index = 1;
+/**
+ * Store a line as the newest entry and index its trigrams; the oldest
+ * entry is dropped once the ring is full
+ * @param line line, either inside the mapping or malloc'ed
+ */
+static void history_push(char *line) {
+  if (history.count - history.first == HISTORY_SIZE)
+    history_evict();
+  int id = history.count++;
+  history.lines[id % HISTORY_SIZE] = line;
+
+  size_t len = strlen(line);
+  for (size_t i = 0; i + 3 <= len; i++) {
+    struct history_posting *p =
+        history_posting(history_trigram(line + i), true);
+    if (p->count > p->head && p->ids[p->count - 1] == id)
+      continue; // trigram repeated within the line
+    if (p->count == p->cap) {
+      p->cap = p->cap ? 2 * p->cap : 4;
+      p->ids = realloc(p->ids, sizeof(int) * p->cap);
     }
-    if (redirect_index != -1) {
-      command->redirects[redirect_index] = (char *)malloc(len);
-      strcpy(command->redirects[redirect_index], arg + 1);
+    p->ids[p->count++] = id;
+  }
+}
+
+/**
+ * Find the last HISTORY_SIZE complete lines of the file's contents
+ * @param  map  file contents
+ * @param  size file size
+ * @param  end  set to the end of the last complete line
+ * @return      start of the first kept line
+ */
+static char *history_tail(char *map, size_t size, char **end) {
+  char *e = map + size;
+  while (e > map && e[-1] != '\n')
+    e--;
+  char *start = e;
+  for (int n = 0; start > map && n < HISTORY_SIZE; n++) {
+    start--; // onto the newline that ends the previous line
+    while (start > map && start[-1] != '\n')
+      start--;
+  }
+  *end = e;
+  return start;
+}
+
+/**
+ * Replace the history file with the given lines if the part before them
+ * is larger, so the rewrite is paid for by as many appended bytes. The
+ * appending descriptor is reopened on the next line.
+ * @param map   file contents
+ * @param start first line to keep
+ * @param end   end of the last line to keep
+ */
+static void history_trim(const char *map, const char *start,
+                         const char *end) {
+  const char *path = history_path();
+  if (path == NULL || start - map < end - start)
+    return;
+  char tmp[1100];
+  if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >=
+      (int)sizeof(tmp))
+    return;
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return;
+  const char *p = start;
+  while (p < end) {
+    ssize_t n = write(fd, p, end - p);
+    if (n < 0 && errno == EINTR)
       continue;
-    }
+    if (n <= 0)
+      break;
+    p += n;
+  }
+  if (close(fd) < 0 || p < end || rename(tmp, path) < 0) {
+    unlink(tmp);
+    return;
+  }
+  if (history.fd >= 0)
+    close(history.fd); // it still appends to the replaced file
+  history.fd = -1;
+  history.appended = 0;
+}
 
-    // normal arguments
-    if (len > 2 &&
-        ((arg[0] == '"' && arg[len - 1] == '"') ||
-         (arg[0] == '\'' && arg[len - 1] == '\''))) // quote wrapped arg
-    {
-      arg[--len] = 0;
-      arg++;
+/**
+ * Trim the history file without loading it into the ring
+ */
+static void history_trim_file() {
+  const char *path = history_path();
+  int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return;
+  char *end, *start = history_tail(map, st.st_size, &end);
+  history_trim(map, start, end);
+  munmap(map, st.st_size);
+}
+
+/**
+ * Read the history file on first use. Only its last HISTORY_SIZE lines
+ * are kept; an unterminated last line (an interrupted write) is skipped.
+ */
+static void history_load() {
+  if (history.loaded)
+    return;
+  history.loaded = true;
+  history.lines = malloc(sizeof(char *) * HISTORY_SIZE);
+
+  const char *path = history_path();
+  int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  history.map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+  close(fd);
+  if (history.map == MAP_FAILED) {
+    history.map = NULL;
+    return;
+  }
+  history.map_size = st.st_size;
+
+  // complete lines only, and of those the last HISTORY_SIZE
+  char *end, *start = history_tail(history.map, history.map_size, &end);
+  history_trim(history.map, start, end); // before the newlines become NULs
+  while (start < end) {
+    char *nl = memchr(start, '\n', end - start);
+    *nl = '\0';
+    if (nl > start)
+      history_push(start);
+    start = nl + 1;
+  }
+  if (history.count > 0) {
+    free(history.last);
+    history.last = strdup(history.lines[(history.count - 1) % HISTORY_SIZE]);
+  }
+}
+
+/**
+ * Record an accepted line: append it to the file, and to the ring if the
+ * history is loaded. Empty lines and repeats of the last line are skipped.
+ * @param line command line without the newline
+ */
+void history_add(const char *line) {
+  size_t len = strlen(line);
+  if (len == 0 || (history.last != NULL && strcmp(history.last, line) == 0))
+    return;
+  free(history.last);
+  history.last = strdup(line);
+
+  if (history.fd < 0) {
+    const char *path = history_path();
+    if (path != NULL)
+      history.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    // terminate a line left unfinished by an interrupted write
+    struct stat st;
+    char tail;
+    if (history.fd >= 0 && fstat(history.fd, &st) == 0 && st.st_size > 0 &&
+        pread(history.fd, &tail, 1, st.st_size - 1) == 1 && tail != '\n' &&
+        write(history.fd, "\n", 1) < 0) {
+      close(history.fd);
+      history.fd = -1;
+    }
+  }
+  if (history.fd >= 0) {
+    // one write, so lines of concurrent shells never mix
+    char *record = malloc(len + 1);
+    memcpy(record, line, len);
+    record[len] = '\n';
+    if (write(history.fd, record, len + 1) < 0) {
+      close(history.fd); // e.g. disk full: keep the history in memory
+      history.fd = -1;
+    } else if (++history.appended >= HISTORY_SIZE) {
+      history.appended = 0;
+      history_trim_file();
     }
-    command->args =
-        (char **)realloc(command->args, sizeof(char *) * (arg_index + 1));
-    command->args[arg_index] = (char *)malloc(len + 1);
-    strcpy(command->args[arg_index++], arg);
+    free(record);
+  }
+  if (history.loaded)
+    history_push(strdup(line));
+}
+
+/**
+ * @param  id history id
+ * @return    the line, or NULL if id is not in the ring
+ */
+static const char *history_get(int id) {
+  if (id < history.first || id >= history.count)
+    return NULL;
+  return history.lines[id % HISTORY_SIZE];
+}
+
+/**
+ * @param  line   history line
+ * @param  query  search text
+ * @param  prefix match only at the start of the line
+ * @return        whether line matches
+ */
+static bool history_match(const char *line, const char *query, bool prefix) {
+  return prefix ? strncmp(line, query, strlen(query)) == 0
+                : strstr(line, query) != NULL;
+}
+
+/**
+ * Find the nearest matching line from a position in either direction
+ * @param  query  search text
+ * @param  prefix match only at the start of the line
+ * @param  from   search starts after this id (exclusive)
+ * @param  dir    -1 for older lines, +1 for newer ones
+ * @return        id of the match, or -1
+ */
+static int history_search(const char *query, bool prefix, int from,
+                          int dir) {
+  history_load();
+  size_t len = strlen(query);
+  if (len < 3) { // short queries match densely: scan the ring
+    for (int id = from + dir; id >= history.first && id < history.count;
+         id += dir)
+      if (history_match(history_get(id), query, prefix))
+        return id;
+    return -1;
   }
-  command->arg_count = arg_index;
 
-  // increase args size by 2
-  command->args = (char **)realloc(command->args,
-                                   sizeof(char *) * (command->arg_count += 2));
+  // every match contains every trigram of the query: walk the rarest
+  struct history_posting *best = NULL;
+  for (size_t i = 0; i + 3 <= len; i++) {
+    struct history_posting *p = history_posting(history_trigram(query + i),
+                                                false);
+    if (p == NULL)
+      return -1;
+    if (best == NULL || p->count - p->head < best->count - best->head)
+      best = p;
+  }
 
-  // shift everything forward by 1
-  for (int i = command->arg_count - 2; i > 0; --i)
-    command->args[i] = command->args[i - 1];
+  // first position in the list past `from` in the search direction
+  int lo = best->head, hi = best->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (best->ids[mid] <= from)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  int i = dir < 0 ? lo - 1 : lo;
+  if (dir < 0 && i >= best->head && best->ids[i] == from)
+    i--;
+  for (; i >= best->head && i < best->count; i += dir) {
+    int id = best->ids[i];
+    if (history_match(history_get(id), query, prefix))
+      return id;
+  }
+  return -1;
+}
 
-  // set args[0] as a copy of name
-  command->args[0] = strdup(command->name);
-  // set args[arg_count-1] (last) to NULL
-  command->args[command->arg_count - 1] = NULL;
+/**
+ * @return id one past the newest line, the position of the line being typed
+ */
+static int history_end() {
+  history_load();
+  return history.count;
+}
 
-  return 0;
+/**
+ * Move through the lines starting with a prefix, skipping the line that
+ * is already shown (up / down arrow)
+ * @param  prefix line typed before navigating
+ * @param  pos    current position, history_end() for the typed line
+ * @param  dir    -1 for older, +1 for newer
+ * @param  shown  text currently in the line buffer
+ * @return        new position; history_end() when moving past the newest
+ */
+static int history_navigate(const char *prefix, int pos, int dir,
+                            const char *shown) {
+  int id = pos;
+  while ((id = history_search(prefix, true, id, dir)) >= 0)
+    if (strcmp(history_get(id), shown) != 0)
+      return id;
+  return dir < 0 ? pos : history_end();
 }
 
+// history [n]: list the last n lines (default: all) with their numbers
+int builtin_history(struct command_t *command) {
+  history_load();
+  int n = history.count - history.first;
+  if (command->args[1] != NULL && atoi(command->args[1]) < n)
+    n = atoi(command->args[1]) > 0 ? atoi(command->args[1]) : 0;
+  for (int id = history.count - n; id < history.count; id++)
+    printf("%6d  %s\n", id + 1, history_get(id));
+  return SUCCESS;
+}
+
+void complete_line(char *buf, int *index); // in the Completion section
+
 void prompt_backspace() {
   putchar(8);   // go back 1
   putchar(' '); // write empty over
@@ -234,16 +861,99 @@ void prompt_backspace() {
 }
 
 /**
- * Prompt a command from the user
- * @param  buf      [description]
- * @param  buf_size [description]
- * @return          [description]
+ * Replace the line being edited, redrawing the prompt
+ * @param buf   line buffer
+ * @param index length of the line, updated
+ * @param text  new contents
+ */
+static void prompt_replace(char *buf, int *index, const char *text) {
+  snprintf(buf, 4096, "%s", text);
+  *index = strlen(buf);
+  printf("\r\033[K");
+  show_prompt();
+  printf("%s", buf);
+}
+
+/**
+ * Read the rest of an escape sequence after ESC
+ * @return final byte of an ESC [ or ESC O sequence ('A' is the up
+ *         arrow), or 0
+ */
+static int prompt_read_escape() {
+  int c = getchar();
+  if (c != '[' && c != 'O')
+    return 0;
+  // parameters such as the 3 of ESC [ 3 ~ come before the final byte
+  while ((c = getchar()) != EOF && (c < 0x40 || c > 0x7e))
+    ;
+  return c == EOF ? 0 : c;
+}
+
+/**
+ * Ctrl+R incremental search: every key refines the query and shows the
+ * newest matching line; Ctrl+R again steps to older matches. Enter runs
+ * the match, Ctrl+G restores the line, any other control key keeps the
+ * match for editing.
+ * @param  buf   line buffer, holds the result
+ * @param  index length of the line, updated
+ * @return       true if the line should be run now
+ */
+static bool prompt_search(char *buf, int *index) {
+  char original[4096], query[256];
+  snprintf(original, sizeof(original), "%s", buf);
+  int qlen = 0, match = -1;
+  bool failed = false;
+  query[0] = '\0';
+
+  while (1) {
+    printf("\r\033[K(%sreverse-i-search)`%s': %s", failed ? "failed " : "",
+           query, match >= 0 ? history_get(match) : "");
+    fflush(stdout);
+
+    int c = getchar();
+    int from = history_end();
+    if (c == 18) { // Ctrl+R: next older match
+      from = match >= 0 ? match : from;
+    } else if (c == 127) {
+      if (qlen > 0)
+        query[--qlen] = '\0';
+    } else if (c >= 32 && c < 127 && qlen < (int)sizeof(query) - 1) {
+      query[qlen++] = c;
+      query[qlen] = '\0';
+      if (match >= 0)
+        from = match + 1; // the current match may still match
+    } else {
+      if (c == 27)
+        prompt_read_escape();
+      bool run = c == '\n';
+      const char *text = original;
+      if (c != 7 && c != EOF && match >= 0) // Ctrl+G cancels
+        text = history_get(match);
+      prompt_replace(buf, index, text);
+      if (run)
+        putchar('\n');
+      return run;
+    }
+
+    int found = qlen > 0 ? history_search(query, false, from, -1) : -1;
+    failed = qlen > 0 && found < 0;
+    if (found >= 0 || qlen == 0)
+      match = found;
+  }
+}
+
+/**
+ * Prompt a command from the user. Up and down arrows step through the
+ * history lines that start with what was typed; Ctrl+R searches it.
+ * @param  command zeroed command, filled in by parse_command()
+ * @return         SUCCESS, or EXIT on end of input
  */
 int prompt(struct command_t *command) {
   int index = 0;
-  char c;
+  int c;
   char buf[4096];
-  static char oldbuf[4096];
+  char typed[4096]; // line as typed before the first arrow key
+  int nav = -1;     // history position shown by the arrows, -1 if none
 
   // tcgetattr gets the parameters of the current terminal
   // STDIN_FILENO will tell tcgetattr that it should write the settings
@@ -262,14 +972,29 @@ int prompt(struct command_t *command) {
 
   show_prompt();
   buf[0] = 0;
+  shell_interrupted = 0;
   while (1) {
     c = getchar();
+    if (c == EOF && ferror(stdin) && errno == EINTR) { // Ctrl+C
+      clearerr(stdin);
+      shell_interrupted = 0;
+      printf("^C\n"); // drop the line, like bash
+      index = 0;
+      nav = -1;
+      show_prompt();
+      continue;
+    }
+    if (c == EOF) { // terminal hung up
+      tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
+      return EXIT;
+    }
     // printf("Keycode: %u\n", c); // DEBUG: uncomment for debugging
 
-    if (c == 9) // handle tab
-    {
-      buf[index++] = '?'; // autocomplete
-      break;
+    if (c == 9) { // tab
+      buf[index] = '\0';
+      complete_line(buf, &index);
+      nav = -1;
+      continue;
     }
 
     if (c == 127) // handle backspace
@@ -278,45 +1003,54 @@ int prompt(struct command_t *command) {
         prompt_backspace();
         index--;
       }
+      nav = -1;
       continue;
     }
 
-    if (c == 27 || c == 91 || c == 66 || c == 67 || c == 68) {
+    if (c == 18) { // Ctrl+R
+      buf[index] = '\0';
+      nav = -1;
+      if (prompt_search(buf, &index))
+        break;
       continue;
     }
 
-    if (c == 65) // up arrow
-    {
-      while (index > 0) {
-        prompt_backspace();
-        index--;
+    if (c == 27) { // only the up and down arrows are bound
+      int key = prompt_read_escape();
+      if (key != 'A' && key != 'B')
+        continue;
+      buf[index] = '\0';
+      if (nav < 0) {
+        strcpy(typed, buf);
+        nav = history_end();
       }
-
-      char tmpbuf[4096];
-      printf("%s", oldbuf);
-      strcpy(tmpbuf, buf);
-      strcpy(buf, oldbuf);
-      strcpy(oldbuf, tmpbuf);
-      index += strlen(buf);
+      nav = history_navigate(typed, nav, key == 'A' ? -1 : 1, buf);
+      prompt_replace(buf, &index, nav < history_end() ? history_get(nav)
+                                                      : typed);
       continue;
     }
 
     putchar(c); // echo the character
     buf[index++] = c;
+    nav = -1;
     if (index >= (int)(sizeof(buf)) - 1)
       break;
     if (c == '\n') // enter key
       break;
-    if (c == 4) // Ctrl+D
+    if (c == 4) { // Ctrl+D
+      tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
       return EXIT;
+    }
   }
   if (index > 0 && buf[index - 1] == '\n') // trim newline from the end
     index--;
   buf[index++] = '\0'; // null terminate string
 
-  strcpy(oldbuf, buf);
+  history_add(buf);
 
+  long t0 = profile_start();
   parse_command(buf, command);
+  profile_add(&profile.parse_ns, t0);
 
   // print_command(command); // DEBUG: uncomment for debugging
 
@@ -325,229 +1059,1849 @@ int prompt(struct command_t *command) {
   return SUCCESS;
 }
 
-int process_command(struct command_t *command) {
-  int r;
-  int pipefd[2];
+/* ─── PATH Lookup Cache ─── */
 
-  if (strcmp(command->name, "") == 0)
-    return SUCCESS;
+// Command name -> executable path, filled lazily like bash's `hash`.
+// The whole table is dropped when PATH changes or when one of the PATH
+// directories is modified (checked at most once per second).
+#define PATH_CACHE_BUCKETS 256
+
+struct path_cache_entry {
+  char *name;
+  char *path;
+  int hits;
+  struct path_cache_entry *next;
+};
 
-  if (strcmp(command->name, "exit") == 0)
-    return EXIT;
+struct path_cache_dir {
+  char *dir;
+  struct timespec mtime; // full resolution: a change within the second counts
+  // executables in the directory, for completion; re-read when mtime
+  // no longer matches listed_mtime
+  char **execs;
+  int exec_count;
+  bool listed;
+  struct timespec listed_mtime;
+};
 
-  if (strcmp(command->name, "cd") == 0) {
-    if (command->arg_count > 0) {
-      r = chdir(command->args[1]);
-      if (r == -1)
-        printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
-      return SUCCESS;
-    }
+static struct path_cache_entry *path_cache[PATH_CACHE_BUCKETS];
+static char *path_cache_env;                   // PATH the cache was built for
+static struct path_cache_dir *path_cache_dirs; // parsed PATH entries
+static int path_cache_dir_count;
+static time_t path_cache_checked; // last time the directory mtimes were read
+
+/**
+ * FNV-1a hash of a command name
+ * @param  s command name
+ * @return   bucket-independent hash value
+ */
+static unsigned path_cache_hash(const char *s) {
+  unsigned h = 2166136261u;
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 16777619u;
   }
+  return h;
+}
 
-  if (command->next != NULL) { // pipe logic
-    if (pipe(pipefd) < 0) {    // pipe creation
-      perror("Pipe failed");
-      return SUCCESS;
+/**
+ * @return whether two modification times are the same
+ */
+static bool path_cache_same_mtime(struct timespec a, struct timespec b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+/**
+ * Forget every cached command location (hash -r)
+ */
+void path_cache_flush() {
+  for (int i = 0; i < PATH_CACHE_BUCKETS; i++) {
+    struct path_cache_entry *e = path_cache[i];
+    while (e) {
+      struct path_cache_entry *next = e->next;
+      free(e->name);
+      free(e->path);
+      free(e);
+      e = next;
     }
+    path_cache[i] = NULL;
+  }
+}
 
-    pid_t pid1 = fork();              // fork for left child
-    if (pid1 == 0) {                  // left child
-      dup2(pipefd[1], STDOUT_FILENO); // redirect stdout to pipe
-      close(pipefd[0]);               // close unused pipe end
-      close(pipefd[1]);
+/**
+ * Split the given PATH value into the directory list and record the
+ * current mtime of every directory
+ * @param env PATH value
+ */
+static void path_cache_load_dirs(const char *env) {
+  for (int i = 0; i < path_cache_dir_count; i++) {
+    free(path_cache_dirs[i].dir);
+    for (int j = 0; j < path_cache_dirs[i].exec_count; j++)
+      free(path_cache_dirs[i].execs[j]);
+    free(path_cache_dirs[i].execs);
+  }
+  free(path_cache_dirs);
+  free(path_cache_env);
+
+  path_cache_env = strdup(env);
+  path_cache_dir_count = 1;
+  for (const char *p = env; *p; p++)
+    if (*p == ':')
+      path_cache_dir_count++;
+  path_cache_dirs = calloc(path_cache_dir_count, sizeof(*path_cache_dirs));
+
+  const char *start = env;
+  for (int i = 0; i < path_cache_dir_count; i++) {
+    const char *end = strchr(start, ':');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+    if (len == 0) // an empty PATH entry means the current directory
+      path_cache_dirs[i].dir = strdup(".");
+    else
+      path_cache_dirs[i].dir = strndup(start, len);
+
+    struct stat st;
+    if (stat(path_cache_dirs[i].dir, &st) == 0)
+      path_cache_dirs[i].mtime = st.st_mtim;
+    start = end ? end + 1 : start + len;
+  }
+  path_cache_checked = time(NULL);
+}
 
-      command->next = NULL;
+/**
+ * Make sure the cache still matches PATH and the directory contents
+ */
+static void path_cache_validate() {
+  const char *env = getenv("PATH");
+  if (env == NULL)
+    env = "";
+
+  if (path_cache_env == NULL || strcmp(path_cache_env, env) != 0) {
+    path_cache_flush();
+    path_cache_load_dirs(env);
+    return;
+  }
 
-      process_command(command); // left command
-      exit(0);
+  time_t now = time(NULL);
+  if (now == path_cache_checked)
+    return;
+  path_cache_checked = now;
+
+  bool changed = false;
+  for (int i = 0; i < path_cache_dir_count; i++) {
+    struct stat st;
+    struct timespec mtime = {0, 0};
+    if (stat(path_cache_dirs[i].dir, &st) == 0)
+      mtime = st.st_mtim;
+    if (!path_cache_same_mtime(mtime, path_cache_dirs[i].mtime)) {
+      path_cache_dirs[i].mtime = mtime;
+      changed = true;
     }
+  }
+  // a new file in an earlier directory may shadow any later hit,
+  // so a change anywhere drops the whole table
+  if (changed)
+    path_cache_flush();
+}
 
-    pid_t pid2 = fork();             // fork for right child
-    if (pid2 == 0) {                 // right child
-      dup2(pipefd[0], STDIN_FILENO); // redirect stdin to pipe
-      close(pipefd[1]);              // close unused pipe end
-      close(pipefd[0]);
+/**
+ * Resolve a command name to an executable path, searching PATH only on a
+ * cache miss. Names containing a '/' are used as-is.
+ * @param  name command name
+ * @return      executable path (owned by the cache), or NULL if not found
+ */
+static const char *path_cache_find(const char *name) {
+  if (strchr(name, '/') != NULL)
+    return access(name, X_OK) == 0 ? name : NULL;
 
-      process_command(command->next); // right command
-      exit(0);
+  path_cache_validate();
+
+  unsigned b = path_cache_hash(name) % PATH_CACHE_BUCKETS;
+  for (struct path_cache_entry *e = path_cache[b]; e; e = e->next) {
+    if (strcmp(e->name, name) == 0) {
+      e->hits++;
+      return e->path;
     }
+  }
 
-    close(pipefd[0]); // close unused pipe ends
-    close(pipefd[1]);
+  char full_path[1024]; // buffer to store the full path of the command
+  for (int i = 0; i < path_cache_dir_count; i++) {
+    snprintf(full_path, sizeof(full_path), "%s/%s", path_cache_dirs[i].dir,
+             name);
+    struct stat st;
+    if (stat(full_path, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(full_path, X_OK) == 0) {
+      struct path_cache_entry *e = malloc(sizeof(*e));
+      e->name = strdup(name);
+      e->path = strdup(full_path);
+      e->hits = 1;
+      e->next = path_cache[b];
+      path_cache[b] = e;
+      return e->path;
+    }
+  }
+  return NULL;
+}
 
-    waitpid(pid1, NULL, 0); // wait for children
-    waitpid(pid2, NULL, 0);
+/**
+ * path_cache_find() with the time it takes counted by --profile
+ * @param  name command name
+ * @return      executable path (owned by the cache), or NULL if not found
+ */
+const char *path_cache_lookup(const char *name) {
+  long t0 = profile_start();
+  const char *path = path_cache_find(name);
+  profile_add(&profile.path_ns, t0);
+  profile.lookups++;
+  return path;
+}
 
+/**
+ * hash builtin: list the cache, `hash -r` to reset it, or `hash name...`
+ * to look names up and remember them
+ * @param  command parsed command
+ * @return         SUCCESS
+ */
+int builtin_hash(struct command_t *command) {
+  int argc = command->arg_count - 1; // args[] is NULL terminated
+  if (argc > 1 && strcmp(command->args[1], "-r") == 0) {
+    path_cache_flush();
     return SUCCESS;
   }
 
-  // handle custom built-in commands that need to run in a child process
-  // (so they support piping and redirection)
-  if (strcmp(command->name, "cut") == 0) {
-    pid_t pid = fork();
-    if (pid == 0) {
-      // handle redirections
-      if (command->redirects[0] != NULL) {
-        int fd_in = open(command->redirects[0], O_RDONLY); // check if file exists and is readable
-        if (fd_in < 0) {
-          perror(
-              "open input file error"); // check if file exists and is readable
-          exit(1);
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      if (path_cache_lookup(command->args[i]) == NULL)
+        printf("-%s: hash: %s: not found\n", sysname, command->args[i]);
+    }
+    return SUCCESS;
+  }
+
+  bool empty = true;
+  for (int i = 0; i < PATH_CACHE_BUCKETS; i++) {
+    for (struct path_cache_entry *e = path_cache[i]; e; e = e->next) {
+      if (empty)
+        printf("hits\tcommand\n");
+      empty = false;
+      printf("%4d\t%s\n", e->hits, e->path);
+    }
+  }
+  if (empty)
+    printf("%s: hash table empty\n", sysname);
+  return SUCCESS;
+}
+
+// how each of command->redirects (<, >, >>) is opened
+static const struct {
+  int flags;
+  int target; // descriptor it replaces
+  const char *error;
+} redirect_modes[3] = {
+    {O_RDONLY, STDIN_FILENO, "open input file error"},
+    {O_WRONLY | O_CREAT | O_TRUNC, STDOUT_FILENO, "open output file error"},
+    {O_WRONLY | O_CREAT | O_APPEND, STDOUT_FILENO, "open append file error"},
+};
+
+/**
+ * Open the file of one redirection, reporting a failure
+ * @param  command parsed command
+ * @param  i       index into command->redirects
+ * @return         close-on-exec descriptor, or -1
+ */
+static int open_redirect(struct command_t *command, int i) {
+  int fd = open(command->redirects[i], redirect_modes[i].flags | O_CLOEXEC,
+                0644);
+  if (fd < 0)
+    perror(redirect_modes[i].error);
+  return fd;
+}
+
+/**
+ * Open the <, > and >> redirections of a command onto stdin / stdout of
+ * the current process
+ * @param  command parsed command
+ * @return         0 on success, -1 if a file could not be opened
+ */
+static int open_redirects(struct command_t *command) {
+  for (int i = 0; i < 3; i++) {
+    if (command->redirects[i] == NULL)
+      continue;
+    int fd = open_redirect(command, i);
+    if (fd < 0)
+      return -1;
+    dup2(fd, redirect_modes[i].target);
+    close(fd);
+  }
+  return 0;
+}
+
+/* ─── Job Table ─── */
+
+// Every pipeline is a job. Foreground jobs are waited for directly and
+// only enter the table if they are stopped; background jobs are listed
+// until they finish. SIGCHLD only writes a byte to a self-pipe: children
+// are reaped by the main loop with wait4() on the job's own PIDs, so no
+// foreground status is ever taken away from the code waiting for it.
+struct job {
+  int id;        // 1, 2, ... once in the table, 0 before
+  pid_t pgid;    // process group with job control, 0 otherwise
+  pid_t *pids;   // one per started stage
+  int *status;   // wait status per stage
+  bool *reaped;  // stage has been waited for
+  int npids;
+  int live;      // stages not reaped yet
+  bool stopped;
+  char *text;    // command line for `jobs`
+  struct rusage usage;   // summed over reaped stages
+  struct timespec start; // CLOCK_MONOTONIC when the job started
+};
+
+static struct job **job_table; // entry i has id i + 1, NULL if free
+static int job_table_cap;
+static int job_current;        // id of the most recent job, 0 if none
+static int sigchld_pipe[2] = {-1, -1}; // written by the SIGCHLD handler
+static bool job_control;       // interactive: jobs get their own groups
+static pid_t shell_pgid;
+int last_status;               // status of the last foreground job
+static struct rusage last_usage; // of the last foreground job, for `time`
+
+static void sigchld_handler(int sig) {
+  (void)sig;
+  int saved = errno;
+  if (write(sigchld_pipe[1], "", 1) < 0) {
+    // the pipe is full: a wake-up is already pending
+  }
+  errno = saved;
+}
+
+/**
+ * Create the self-pipe and install the SIGCHLD handler
+ */
+static void jobs_init() {
+  if (pipe(sigchld_pipe) == 0) {
+    for (int i = 0; i < 2; i++) {
+      fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK);
+      fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sigchld_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGCHLD, &sa, NULL);
+}
+
+/**
+ * Create a job for a parsed pipeline. The text is rebuilt from the
+ * stages, since the command line itself lives in the parse arena.
+ * @param  command first stage
+ * @return         new job with no processes yet
+ */
+static struct job *job_new(struct command_t *command) {
+  struct job *job = calloc(1, sizeof(struct job));
+  int stages = 0;
+  size_t len = 1;
+  for (struct command_t *c = command; c; c = c->next, stages++)
+    for (int i = 0; c->args[i]; i++)
+      len += strlen(c->args[i]) + 4;
+  job->pids = malloc(sizeof(pid_t) * stages);
+  job->status = calloc(stages, sizeof(int));
+  job->reaped = calloc(stages, sizeof(bool));
+
+  job->text = malloc(len + 2);
+  char *p = job->text;
+  for (struct command_t *c = command; c; c = c->next) {
+    for (int i = 0; c->args[i]; i++)
+      p += sprintf(p, i ? " %s" : "%s", c->args[i]);
+    if (c->next)
+      p += sprintf(p, " | ");
+  }
+  if (command->background)
+    strcpy(p, " &");
+  clock_gettime(CLOCK_MONOTONIC, &job->start);
+  return job;
+}
+
+static void job_free(struct job *job) {
+  free(job->pids);
+  free(job->status);
+  free(job->reaped);
+  free(job->text);
+  free(job);
+}
+
+static void job_add_pid(struct job *job, pid_t pid) {
+  job->pids[job->npids++] = pid;
+  job->live++;
+  if (job_control && job->pgid == 0)
+    job->pgid = pid; // the first stage leads the group
+}
+
+/**
+ * Record a wait4() result for one of the job's processes
+ * @param job    job
+ * @param i      stage index
+ * @param status wait status
+ * @param ru     resource usage of the process
+ */
+static void job_update(struct job *job, int i, int status,
+                       const struct rusage *ru) {
+  if (WIFSTOPPED(status)) {
+    job->stopped = true;
+    return;
+  }
+  if (WIFCONTINUED(status)) {
+    job->stopped = false;
+    return;
+  }
+  job->status[i] = status;
+  job->reaped[i] = true;
+  job->live--;
+  timeradd(&job->usage.ru_utime, &ru->ru_utime, &job->usage.ru_utime);
+  timeradd(&job->usage.ru_stime, &ru->ru_stime, &job->usage.ru_stime);
+  if (ru->ru_maxrss > job->usage.ru_maxrss)
+    job->usage.ru_maxrss = ru->ru_maxrss;
+  job->usage.ru_nvcsw += ru->ru_nvcsw;
+  job->usage.ru_nivcsw += ru->ru_nivcsw;
+}
+
+/**
+ * Wait for the job's processes until all exit or one is stopped
+ * @param  job   job
+ * @param  flags WNOHANG to only collect what has already changed
+ * @return       true if Ctrl+C interrupted the wait in the shell
+ */
+static bool job_wait(struct job *job, int flags) {
+  for (int i = 0; i < job->npids; i++) {
+    while (!job->reaped[i]) {
+      int status;
+      struct rusage ru;
+      pid_t r = wait4(job->pids[i], &status, flags | WUNTRACED | WCONTINUED,
+                      &ru);
+      if (r < 0 && errno == EINTR && shell_interrupted)
+        return true;
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0) {
+        if (r < 0) { // already gone: do not wait forever
+          job->reaped[i] = true;
+          job->live--;
         }
-        dup2(fd_in, STDIN_FILENO); // duplicate the file descriptor to stdin
-        close(fd_in);              // close the file descriptor
+        break;
       }
-      if (command->redirects[1] != NULL) {
-        int fd_out = open(command->redirects[1], O_WRONLY | O_CREAT | O_TRUNC,
-                          0644); // check if file exists and is writable
-        if (fd_out < 0) {
-          perror(
-              "open output file error"); // check if file exists and is writable
-          exit(1);
-        }
-        dup2(fd_out, STDOUT_FILENO); // duplicate the file descriptor to stdout
-        close(fd_out);               // close the file descriptor
+      job_update(job, i, status, &ru);
+      if (WIFSTOPPED(status)) {
+        if (!(flags & WNOHANG))
+          return false; // stopped in the foreground: hand back to the shell
+        break;
       }
-      if (command->redirects[2] != NULL) {
-        int fd_append =
-            open(command->redirects[2], O_WRONLY | O_CREAT | O_APPEND,
-                 0644); // check if file exists and is writable
-        if (fd_append < 0) {
-          perror(
-              "open append file error"); // check if file exists and is writable
-          exit(1);
-        }
-        dup2(fd_append,
-             STDOUT_FILENO); // duplicate the file descriptor to stdout
-        close(fd_append);    // close the file descriptor
+    }
+  }
+  return false;
+}
+
+/**
+ * Exit code of a finished job, taken from its last stage
+ * @param  job job
+ * @return     exit status, or 128 + signal number
+ */
+static int job_exit_code(const struct job *job) {
+  if (job->npids == 0)
+    return 127; // command not found
+  int status = job->status[job->npids - 1];
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+static struct job *job_find(int id) {
+  if (id < 1 || id > job_table_cap)
+    return NULL;
+  return job_table[id - 1];
+}
+
+/**
+ * Put a job into the table under the smallest free id
+ * @param job job
+ */
+static void job_insert(struct job *job) {
+  int i = 0;
+  while (i < job_table_cap && job_table[i] != NULL)
+    i++;
+  if (i == job_table_cap) {
+    int cap = job_table_cap ? job_table_cap * 2 : 16;
+    job_table = realloc(job_table, sizeof(struct job *) * cap);
+    memset(job_table + job_table_cap, 0,
+           sizeof(struct job *) * (cap - job_table_cap));
+    job_table_cap = cap;
+  }
+  job_table[i] = job;
+  job->id = i + 1;
+  job_current = job->id;
+}
+
+static void job_remove(struct job *job) {
+  job_table[job->id - 1] = NULL;
+  if (job_current == job->id) { // fall back to the newest remaining job
+    job_current = 0;
+    for (int i = 0; i < job_table_cap; i++)
+      if (job_table[i] != NULL)
+        job_current = i + 1;
+  }
+  job_free(job);
+}
+
+/**
+ * Print one line about a job, as `jobs` and the notifications do
+ * @param job   job
+ * @param usage also print exit status and resource usage
+ */
+static void job_print(const struct job *job, bool usage) {
+  char state[32];
+  if (job->stopped)
+    strcpy(state, "Stopped");
+  else if (job->live > 0)
+    strcpy(state, "Running");
+  else if (job_exit_code(job) == 0)
+    strcpy(state, "Done");
+  else
+    snprintf(state, sizeof(state), "Exit %d", job_exit_code(job));
+
+  printf("[%d]%c  %-10s %s", job->id, job->id == job_current ? '+' : ' ',
+         state, job->text);
+  if (usage && job->live == 0)
+    printf("  (%ld.%02lds user, %ld.%02lds sys, %ld KB max RSS)",
+           (long)job->usage.ru_utime.tv_sec,
+           (long)job->usage.ru_utime.tv_usec / 10000,
+           (long)job->usage.ru_stime.tv_sec,
+           (long)job->usage.ru_stime.tv_usec / 10000, job->usage.ru_maxrss);
+  printf("\n");
+}
+
+/**
+ * Collect state changes of background jobs and report them. Cheap when
+ * nothing happened: only the self-pipe is read. Without job control
+ * (scripts) finished jobs are reaped silently and kept for `wait` and
+ * `jobs`.
+ */
+static void jobs_notify() {
+  char buf[64];
+  bool woken = false;
+  while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+    woken = true;
+  if (!woken)
+    return;
+
+  for (int i = 0; i < job_table_cap; i++) {
+    struct job *job = job_table[i];
+    if (job == NULL)
+      continue;
+    bool was_stopped = job->stopped;
+    job_wait(job, WNOHANG);
+    if (job->live == 0) {
+      if (job_control) {
+        job_print(job, true);
+        job_remove(job);
       }
-      handle_cut(command->arg_count, command->args); // execute the cut command
-      exit(0);
-    } else {
-      if (!command->background)
-        waitpid(pid, NULL, 0); // wait for the child process to finish
-      return SUCCESS;
+    } else if (job->stopped != was_stopped) {
+      job_print(job, false);
     }
   }
+  fflush(stdout);
+}
 
-  if (strcmp(command->name, "chatroom") == 0) {
-    pid_t pid = fork();
-    if (pid == 0) {
-      chatroom(command->arg_count,
-               command->args); // execute the chatroom command
-      exit(0);
-    } else {
-      if (!command->background)
-        waitpid(pid, NULL, 0); // wait for the child process to finish
-      return SUCCESS;
+/**
+ * Send a signal to every process of a job
+ * @param job job
+ * @param sig signal number
+ */
+static void job_kill(struct job *job, int sig) {
+  if (job->pgid > 0)
+    kill(-job->pgid, sig);
+  else
+    for (int i = 0; i < job->npids; i++)
+      kill(job->pids[i], sig);
+}
+
+/**
+ * Run a job in the foreground until it exits or is stopped. With job
+ * control the terminal is handed to the job's process group meanwhile.
+ * A stopped job is put into the table; a finished one is freed.
+ * @param  job  job (not in the table, or resumed from it)
+ * @param  cont send SIGCONT first (fg)
+ * @return      the job's exit code
+ */
+static int job_foreground(struct job *job, bool cont) {
+  if (job_control && job->pgid > 0)
+    tcsetpgrp(STDIN_FILENO, job->pgid);
+  if (cont) {
+    job->stopped = false;
+    job_kill(job, SIGCONT);
+  }
+
+  while (job_wait(job, 0)) // the job has the terminal: not our Ctrl+C
+    shell_interrupted = 0;
+  if (job_control)
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
+  last_usage = job->usage;
+
+  if (job->stopped) {
+    if (job->id == 0)
+      job_insert(job);
+    job_current = job->id;
+    printf("\n");
+    job_print(job, false);
+    fflush(stdout);
+    return 128 + SIGTSTP;
+  }
+  int code = job_exit_code(job);
+  if (job->id != 0)
+    job_remove(job);
+  else
+    job_free(job);
+  return code;
+}
+
+/**
+ * Parse a job argument (N or %N); no argument means the current job
+ * @param  name built-in name, for the error message
+ * @param  arg  argument, or NULL
+ * @return     job, or NULL after printing an error
+ */
+static struct job *job_from_arg(const char *name, const char *arg) {
+  int id = job_current;
+  if (arg != NULL)
+    id = atoi(arg[0] == '%' ? arg + 1 : arg);
+  struct job *job = job_find(id);
+  if (job == NULL)
+    printf("-%s: %s: %s: no such job\n", sysname, name,
+           arg ? arg : "current");
+  return job;
+}
+
+/* ─── Built-in Commands ─── */
+
+enum builtin_flags {
+  BUILTIN_FORK = 1,   // never runs inside the shell process
+  BUILTIN_PREFIX = 2, // runs the rest of the line, pipes included
+};
+
+struct builtin_t {
+  const char *name;
+  int (*fn)(struct command_t *);
+  int flags;
+};
+
+int builtin_exit(struct command_t *command) {
+  (void)command;
+  return EXIT;
+}
+
+int builtin_cd(struct command_t *command) {
+  if (command->arg_count > 0) {
+    int r = chdir(command->args[1]);
+    if (r == -1)
+      printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
+  }
+  return SUCCESS;
+}
+
+int builtin_cut(struct command_t *command) {
+  handle_cut(command->arg_count, command->args); // execute the cut command
+  return SUCCESS;
+}
+
+int builtin_chatroom(struct command_t *command) {
+  chatroom(command->arg_count, command->args); // execute the chatroom command
+  return SUCCESS;
+}
+
+int builtin_process_tree(struct command_t *command) {
+  handle_process_tree(command->arg_count,
+                      command->args); // execute the process_tree command
+  return SUCCESS;
+}
+
+int builtin_jobs(struct command_t *command) {
+  (void)command;
+  jobs_notify();
+  for (int i = 0; i < job_table_cap; i++) {
+    struct job *job = job_table[i];
+    if (job == NULL)
+      continue;
+    job_print(job, false);
+    if (job->live == 0) { // reported once, like a notification
+      job_remove(job);
     }
   }
+  return SUCCESS;
+}
 
-  if (strcmp(command->name, "process_tree") == 0) {
-    pid_t pid = fork();
-    if (pid == 0) {
-      handle_process_tree(command->arg_count, command->args); // execute the process_tree command
-      exit(0);
-    } else {
-      if (!command->background)
-        waitpid(pid, NULL, 0); // wait for the child process to finish
-      return SUCCESS;
+/**
+ * Wait for a job to finish, report it and drop it from the table
+ * @param  job job
+ * @return     its exit code
+ */
+static int job_collect(struct job *job) {
+  if (job_wait(job, 0))
+    return 128 + SIGINT; // Ctrl+C: stop waiting, the job keeps running
+  if (job->stopped)
+    return 128 + SIGTSTP;
+  int code = job_exit_code(job);
+  job_print(job, true);
+  job_remove(job);
+  return code;
+}
+
+// wait [id ...]: block until the given jobs (default: all running ones)
+// finish, then report each with its exit status and resource usage
+int builtin_wait(struct command_t *command) {
+  int code = 0;
+  if (command->args[1] == NULL) {
+    for (int i = 0; i < job_table_cap && !shell_interrupted; i++)
+      if (job_table[i] != NULL && !job_table[i]->stopped)
+        code = job_collect(job_table[i]);
+  } else {
+    for (int i = 1; command->args[i] != NULL && !shell_interrupted; i++) {
+      struct job *job = job_from_arg(command->name, command->args[i]);
+      code = job ? job_collect(job) : 127;
     }
   }
+  last_status = code;
+  return SUCCESS;
+}
+
+int builtin_fg(struct command_t *command) {
+  struct job *job = job_from_arg(command->name, command->args[1]);
+  if (job == NULL)
+    return SUCCESS;
+  printf("%s\n", job->text);
+  fflush(stdout);
+  last_status = job_foreground(job, true);
+  return SUCCESS;
+}
+
+int builtin_bg(struct command_t *command) {
+  struct job *job = job_from_arg(command->name, command->args[1]);
+  if (job == NULL)
+    return SUCCESS;
+  job->stopped = false;
+  job_kill(job, SIGCONT);
+  printf("[%d]%c %s\n", job->id, job->id == job_current ? '+' : ' ',
+         job->text);
+  return SUCCESS;
+}
 
-  pid_t pid = fork();
-  if (pid == 0) // child
-  {
-    /// This shows how to do exec with environ (but is not available on MacOs)
-    // extern char** environ; // environment variables
-    // execvpe(command->name, command->args, environ); // exec+args+path+environ
+int builtin_parallel(struct command_t *command); // after the spawn path
+int builtin_time(struct command_t *command);     // after process_command
+
+// Sorted by name for bsearch(). chatroom installs its own SIGINT handler
+// that exits and forks a reader, so it always gets its own process.
+static const struct builtin_t builtins[] = {
+    {"bg", builtin_bg, 0},
+    {"cd", builtin_cd, 0},
+    {"chatroom", builtin_chatroom, BUILTIN_FORK},
+    {"cut", builtin_cut, 0},
+    {"exit", builtin_exit, 0},
+    {"fg", builtin_fg, 0},
+    {"hash", builtin_hash, 0},
+    {"history", builtin_history, 0},
+    {"jobs", builtin_jobs, 0},
+    {"parallel", builtin_parallel, 0},
+    {"process_tree", builtin_process_tree, 0},
+    {"time", builtin_time, BUILTIN_PREFIX},
+    {"wait", builtin_wait, 0},
+};
+
+static int builtin_compare(const void *key, const void *elem) {
+  return strcmp((const char *)key, ((const struct builtin_t *)elem)->name);
+}
 
-    /// This shows how to do exec with auto-path resolve
-    // add a NULL argument to the end of args, and the name to the beginning
-    // as required by exec
+/**
+ * Look up a built-in command by name
+ * @param  name command name
+ * @return      table entry, or NULL for external commands
+ */
+static const struct builtin_t *find_builtin(const char *name) {
+  return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]),
+                 sizeof(builtins[0]), builtin_compare);
+}
 
-    // TODO: do your own exec with path resolving using execv()
-    // do so by replacing the execvp call below
-    // execvp(command->name, command->args); // exec+args+path
+/**
+ * Run a built-in inside the shell process. Redirections are applied to
+ * the shell's own stdin / stdout and undone afterwards through saved fds.
+ * @param  b       table entry
+ * @param  command parsed command
+ * @return         the built-in's return code
+ */
+static int run_builtin_in_shell(const struct builtin_t *b,
+                                struct command_t *command) {
+  if (!command->redirects[0] && !command->redirects[1] &&
+      !command->redirects[2])
+    return b->fn(command);
+
+  fflush(stdout);
+  int saved_in = dup(STDIN_FILENO);
+  int saved_out = dup(STDOUT_FILENO);
+
+  int r = SUCCESS;
+  if (open_redirects(command) == 0)
+    r = b->fn(command);
+
+  fflush(stdout);
+  dup2(saved_in, STDIN_FILENO);
+  dup2(saved_out, STDOUT_FILENO);
+  close(saved_in);
+  close(saved_out);
+  clearerr(stdin); // the built-in may have read a redirected file to EOF
+  return r;
+}
+
+/**
+ * Run a single command in the current, already forked process. Never
+ * returns: either execs or exits with the command's status.
+ * @param command   parsed command
+ * @param b         built-in table entry, or NULL for external commands
+ * @param exec_path resolved executable for external commands
+ */
+static void exec_command(struct command_t *command, const struct builtin_t *b,
+                         const char *exec_path) {
+  if (open_redirects(command) < 0)
+    exit(1);
+
+  // built-ins in a pipeline or in the background run in this child;
+  // cd and exit therefore do not affect the shell
+  // _exit() so the inherited stdin stream is not cleaned up, which would
+  // move the file offset the shell shares with us
+  if (b != NULL) {
+    command->next = NULL; // this child runs only its own stage
+    command->background = false;
+    b->fn(command);
+    fflush(stdout);
+    _exit(0);
+  }
+  if (exec_path == NULL) // callers resolve the command before forking
+    exit(127);
+
+  execv(exec_path, command->args); // execute the command
+  perror("execv failed");          // print error message if execv fails
+  exit(127);
+}
+
+#ifndef USE_FORK_EXEC
+extern char **environ;
+
+/**
+ * Start an external pipeline stage with posix_spawn() instead of fork(),
+ * so the shell's page tables are never copied. Pipe ends and the <, > and
+ * >> redirections are applied through spawn file actions, in the same
+ * order exec_command() applies them after a fork.
+ * @param  command   parsed command of this stage
+ * @param  exec_path resolved executable
+ * @param  pipes     all pipes of the pipeline
+ * @param  npipes    number of pipes
+ * @param  stage     index of this stage
+ * @param  pgid      process group of the job (0: start a new one)
+ * @param  foreground whether the job takes over the terminal
+ * @return           pid of the new process, or -1 on error
+ */
+static pid_t spawn_stage(struct command_t *command, const char *exec_path,
+                         int (*pipes)[2], int npipes, int stage, pid_t pgid,
+                         bool foreground) {
+  long t0 = profile_start();
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 35)
+  // the leader takes the terminal itself, before a later stage can read
+  // from it; everywhere else the parent hands it over right after the spawn
+  if (job_control && foreground && pgid == 0)
+    posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+#else
+  (void)foreground;
+#endif
+
+  // signals the interactive shell ignores go back to their defaults, and
+  // with job control the stage joins the job's process group
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t defaults;
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGTSTP);
+  sigaddset(&defaults, SIGTTIN);
+  sigaddset(&defaults, SIGTTOU);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  short spawn_flags = POSIX_SPAWN_SETSIGDEF;
+  if (job_control) {
+    posix_spawnattr_setpgroup(&attr, pgid);
+    spawn_flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  posix_spawnattr_setflags(&attr, spawn_flags);
+
+  if (stage > 0) // read from previous stage
+    posix_spawn_file_actions_adddup2(&actions, pipes[stage - 1][0],
+                                     STDIN_FILENO);
+  if (stage < npipes) // write to next stage
+    posix_spawn_file_actions_adddup2(&actions, pipes[stage][1], STDOUT_FILENO);
+  for (int j = 0; j < npipes; j++) { // close all pipe ends
+    posix_spawn_file_actions_addclose(&actions, pipes[j][0]);
+    posix_spawn_file_actions_addclose(&actions, pipes[j][1]);
+  }
+
+  // the files are opened here rather than by the child, so a failure is
+  // reported for the file, as on the fork path, and nothing is started
+  int files[3] = {-1, -1, -1};
+  int err = 0;
+  for (int i = 0; i < 3 && err == 0; i++) {
+    if (command->redirects[i] == NULL)
+      continue;
+    files[i] = open_redirect(command, i);
+    if (files[i] < 0)
+      err = -1;
+    else
+      posix_spawn_file_actions_adddup2(&actions, files[i],
+                                       redirect_modes[i].target);
+  }
+
+  pid_t pid = -1;
+  if (err == 0)
+    err = posix_spawn(&pid, exec_path, &actions, &attr, command->args,
+                      environ);
+  for (int i = 0; i < 3; i++)
+    if (files[i] >= 0)
+      close(files[i]);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  profile_add(&profile.spawn_ns, t0);
+  profile.spawns++;
+  if (err > 0) {
+    printf("-%s: %s: %s\n", sysname, command->name, strerror(err));
+    fflush(stdout);
+  }
+  return err == 0 ? pid : -1;
+}
+#endif
+
+/**
+ * Restore what the interactive shell changed before a forked stage runs
+ * @param pgid       process group of the job (0: start a new one)
+ * @param foreground whether the job takes over the terminal
+ */
+static void job_child_setup(pid_t pgid, bool foreground) {
+  if (job_control) {
+    setpgid(0, pgid);
+    if (foreground) // SIGTTOU is still ignored here
+      tcsetpgrp(STDIN_FILENO, getpgrp());
+  }
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTSTP, SIG_DFL);
+  signal(SIGTTIN, SIG_DFL);
+  signal(SIGTTOU, SIG_DFL);
+}
 
-    if (command->redirects[0] != NULL) {
-      // handle redirection
-      int fd_in = open(command->redirects[0], O_RDONLY); // open input file
-      if (fd_in < 0) {
-        perror("open input file error");
-        exit(1);
+/**
+ * Run a pipeline of one or more commands linked through command->next.
+ * All pipes are created up front and exactly one child is started per
+ * stage. The stages form one job: in the background it goes into the
+ * job table, otherwise it is waited for in the foreground.
+ * @param  command first stage of the pipeline
+ * @return         SUCCESS
+ */
+static int run_pipeline(struct command_t *command) {
+  int stages = 0;
+  for (struct command_t *c = command; c; c = c->next)
+    stages++;
+
+  int(*pipes)[2] = malloc(sizeof(int[2]) * (stages > 1 ? stages - 1 : 1));
+  for (int i = 0; i < stages - 1; i++) {
+    if (pipe(pipes[i]) < 0) { // pipe creation
+      perror("Pipe failed");
+      for (int j = 0; j < i; j++) {
+        close(pipes[j][0]);
+        close(pipes[j][1]);
       }
-      dup2(fd_in, STDIN_FILENO); // duplicate the file descriptor
-      close(fd_in);              // close the file descriptor
+      free(pipes);
+      return SUCCESS;
     }
+  }
 
-    if (command->redirects[1] != NULL) {
-      // handle redirection
-      int fd_out = open(command->redirects[1], O_WRONLY | O_CREAT | O_TRUNC, 0644); // open output file
-      if (fd_out < 0) {
-        perror("open output file error");
-        exit(1);
+  // parent's pending output must not be flushed a second time by children
+  fflush(stdout);
+
+  struct job *job = job_new(command);
+  int i = 0;
+  for (struct command_t *c = command; c; c = c->next, i++) {
+    if (strcmp(c->name, "") == 0)
+      continue;
+
+    // resolve the executable in the parent so the lookup is cached
+    // across commands; the child only has to execv()
+    const struct builtin_t *b = find_builtin(c->name);
+    const char *exec_path = NULL;
+    if (b == NULL) {
+      exec_path = path_cache_lookup(c->name);
+      if (exec_path == NULL) {
+        // no process for this stage: its neighbours see EOF / EPIPE
+        printf("-%s: %s: command not found\n", sysname, c->name);
+        fflush(stdout);
+        continue;
       }
-      dup2(fd_out, STDOUT_FILENO); // duplicate the file descriptor
-      close(fd_out);               // close the file descriptor
     }
 
-    if (command->redirects[2] != NULL) {
-      // handle redirection
-      int fd_append = open(command->redirects[2], O_WRONLY | O_CREAT | O_APPEND, 0644); // open append file
-      if (fd_append < 0) {
-        perror("open append file error");
-        exit(1);
+    pid_t pid;
+#ifndef USE_FORK_EXEC
+    // external commands are spawned; only built-ins need a forked copy
+    // of the shell
+    if (exec_path != NULL) {
+      pid = spawn_stage(c, exec_path, pipes, stages - 1, i, job->pgid,
+                        !command->background);
+      if (pid > 0)
+        job_add_pid(job, pid);
+      if (pid > 0 && job_control && !command->background && job->npids == 1)
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+      continue;
+    }
+#endif
+
+    long t0 = profile_start();
+    pid = fork();
+    if (pid > 0) {
+      profile_add(&profile.spawn_ns, t0);
+      profile.spawns++;
+    }
+    if (pid < 0) {
+      perror("fork");
+      continue;
+    }
+    if (pid == 0) { // stage child
+      job_child_setup(job->pgid, !command->background);
+      if (i > 0)
+        dup2(pipes[i - 1][0], STDIN_FILENO); // read from previous stage
+      if (i < stages - 1)
+        dup2(pipes[i][1], STDOUT_FILENO); // write to next stage
+      for (int j = 0; j < stages - 1; j++) { // close all pipe ends
+        close(pipes[j][0]);
+        close(pipes[j][1]);
       }
-      dup2(fd_append, STDOUT_FILENO); // duplicate the file descriptor
-      close(fd_append);               // close the file descriptor
+      exec_command(c, b, exec_path);
     }
+    if (job_control) // also in the parent, so there is no race
+      setpgid(pid, job->pgid ? job->pgid : pid);
+    job_add_pid(job, pid);
+    if (job_control && !command->background && job->npids == 1)
+      tcsetpgrp(STDIN_FILENO, job->pgid);
+  }
+
+  for (int j = 0; j < stages - 1; j++) { // close unused pipe ends
+    close(pipes[j][0]);
+    close(pipes[j][1]);
+  }
+  free(pipes);
+
+  if (!command->background) {
+    last_status = job_foreground(job, false);
+  } else if (job->npids == 0) {
+    job_free(job);
+  } else {
+    job_insert(job);
+    if (job_control)
+      printf("[%d] %d\n", job->id, job->pids[job->npids - 1]);
+  }
+  return SUCCESS;
+}
+
+int process_command(struct command_t *command) {
+  if (strcmp(command->name, "") == 0)
+    return SUCCESS;
+
+  // a lone foreground built-in needs no fork at all
+  const struct builtin_t *b = find_builtin(command->name);
+  if (b != NULL && (b->flags & BUILTIN_PREFIX))
+    return b->fn(command);
+  if (b != NULL && command->next == NULL && !command->background &&
+      !(b->flags & BUILTIN_FORK))
+    return run_builtin_in_shell(b, command);
+
+  return run_pipeline(command);
+}
+
+/**
+ * Print a time value the way bash's `time` does
+ * @param label line label
+ * @param tv    duration
+ */
+static void time_print(const char *label, struct timeval tv) {
+  fprintf(stderr, "%s\t%ldm%ld.%03lds\n", label, (long)tv.tv_sec / 60,
+          (long)tv.tv_sec % 60, (long)tv.tv_usec / 1000);
+}
+
+// time command [| command ...]: run the rest of the line and report its
+// wall clock, user and system time, peak RSS and context switches on
+// stderr. Child usage comes from wait4() on the job's processes; time
+// spent inside the shell (built-ins, starting the processes) is added
+// from getrusage(). A background job is only started; its completion
+// notice carries its usage.
+int builtin_time(struct command_t *command) {
+  memmove(command->args, command->args + 1,
+          sizeof(char *) * (command->arg_count - 1)); // NULL included
+  command->arg_count--;
+  command->name = command->args[0] ? command->args[0] : "";
+
+  struct rusage self_before, self_after;
+  struct timespec start, end;
+  memset(&last_usage, 0, sizeof(last_usage));
+  getrusage(RUSAGE_SELF, &self_before);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int r = process_command(command);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  getrusage(RUSAGE_SELF, &self_after);
+  if (command->background)
+    return r;
+
+  struct timeval real, user, sys;
+  real.tv_sec = end.tv_sec - start.tv_sec;
+  real.tv_usec = (end.tv_nsec - start.tv_nsec) / 1000;
+  if (real.tv_usec < 0) {
+    real.tv_sec--;
+    real.tv_usec += 1000000;
+  }
+  timersub(&self_after.ru_utime, &self_before.ru_utime, &user);
+  timeradd(&user, &last_usage.ru_utime, &user);
+  timersub(&self_after.ru_stime, &self_before.ru_stime, &sys);
+  timeradd(&sys, &last_usage.ru_stime, &sys);
+  // a built-in that ran in the shell has no child: use the shell's peak
+  long maxrss = last_usage.ru_maxrss ? last_usage.ru_maxrss
+                                     : self_after.ru_maxrss;
+
+  fflush(stdout);
+  fprintf(stderr, "\n");
+  time_print("real", real);
+  time_print("user", user);
+  time_print("sys", sys);
+  fprintf(stderr, "rss\t%ld KB max\n", maxrss);
+  fprintf(stderr, "csw\t%ld voluntary, %ld involuntary\n",
+          last_usage.ru_nvcsw + self_after.ru_nvcsw - self_before.ru_nvcsw,
+          last_usage.ru_nivcsw + self_after.ru_nivcsw - self_before.ru_nivcsw);
+  return r;
+}
 
-    char *path_env = getenv("PATH");    // get the path environment variable
-    char *path_copy = strdup(path_env); // copy the path environment variable
-    char *token = strtok(path_copy, ":"); // token changes on each call, so we used a copy of path_env
+/* ─── Parallel ─── */
 
-    char full_path[1024]; // buffer to store the full path of the command
-    while (token != NULL) {
-      snprintf(full_path, sizeof(full_path), "%s/%s", token, command->name); // concatenate the token and the command name
+// one running task of `parallel` and the output it has produced so far
+struct parallel_slot {
+  struct job *job; // NULL when the slot is free
+  int fd;          // read end of the task's stdout, -1 after EOF
+  char *out;
+  size_t len, cap;
+};
 
-      if (access(full_path, X_OK) == 0) { // check if the command is executable
-        free(path_copy);                  // free before exec replaces process
-        execv(full_path, command->args);  // execute the command
-        perror("execv failed");           // print error message if execv fails
-        exit(127);
+// SIGINT or SIGTERM received while `parallel` runs, 0 if none
+static volatile sig_atomic_t parallel_signal;
+
+static void parallel_handler(int sig) {
+  parallel_signal = sig;
+  sigchld_handler(sig); // wakes the poll() loop
+}
+
+/**
+ * Build the command line of one task: every {} in the template is
+ * replaced by the input, or the input is appended if there is no {}
+ * @param  argv   template words, NULL-terminated
+ * @param  input  input of this task
+ * @return        command allocated from the line arena
+ */
+static struct command_t *parallel_task(char **argv, const char *input) {
+  int argc = 0;
+  bool placeholder = false;
+  for (; argv[argc] != NULL; argc++)
+    placeholder |= strstr(argv[argc], "{}") != NULL;
+
+  struct command_t *task = arena_alloc(&line_arena, sizeof(*task));
+  task->args = arena_alloc(&line_arena, sizeof(char *) * (argc + 2));
+  size_t input_len = strlen(input);
+  for (int i = 0; i < argc; i++) {
+    size_t len = strlen(argv[i]);
+    for (const char *p = argv[i]; (p = strstr(p, "{}")) != NULL; p += 2)
+      len += input_len;
+    char *word = arena_alloc(&line_arena, len + 1), *w = word;
+    for (const char *p = argv[i]; *p;) {
+      if (p[0] == '{' && p[1] == '}') {
+        memcpy(w, input, input_len);
+        w += input_len;
+        p += 2;
+      } else {
+        *w++ = *p++;
       }
-      token = strtok(NULL, ":"); // get the next token
     }
-    free(path_copy); // free the copied path before exiting
-    printf("-%s: %s: command not found\n", sysname, command->name);
-    exit(127);
-  } else {
-    // TODO: implement background processes here
-    // wait(0);
-    if (!command->background) { // if the command is not in background, wait for it to finish
-      waitpid(pid, NULL, 0);    // wait for the child process to finish
-    };
+    task->args[i] = word;
+  }
+  if (!placeholder)
+    task->args[argc++] = (char *)input;
+  task->name = task->args[0];
+  task->arg_count = argc + 1; // counts the NULL, like parse_command
+  // tasks must not compete for the shell's stdin
+  task->redirects[0] = "/dev/null";
+  return task;
+}
+
+/**
+ * Start one task with its stdout going into a pipe
+ * @param  slot slot to fill
+ * @param  task command of the task
+ * @return      0, or -1 if no process could be started
+ */
+static int parallel_start(struct parallel_slot *slot,
+                          struct command_t *task) {
+  int out[1][2];
+  if (pipe(out[0]) < 0) {
+    perror("pipe");
+    return -1;
+  }
+  // the read end stays open while later tasks start; they must not
+  // inherit it
+  fcntl(out[0][0], F_SETFD, FD_CLOEXEC);
+  slot->job = job_new(task);
+  slot->fd = out[0][0];
+  slot->len = 0;
+
+  const struct builtin_t *b = find_builtin(task->name);
+  const char *exec_path = NULL;
+  if (b == NULL && (exec_path = path_cache_lookup(task->name)) == NULL) {
+    printf("-%s: %s: command not found\n", sysname, task->name);
+    fflush(stdout);
+    close(out[0][1]); // the task finishes with status 127 on EOF
+    return 0;
+  }
+
+  pid_t pid;
+#ifndef USE_FORK_EXEC
+  if (exec_path != NULL) {
+    pid = spawn_stage(task, exec_path, out, 1, 0, 0, false);
+    if (pid > 0)
+      job_add_pid(slot->job, pid);
+    close(out[0][1]);
+    return 0;
+  }
+#endif
+  fflush(stdout); // or the child flushes our pending output again
+  long t0 = profile_start();
+  pid = fork();
+  if (pid > 0) {
+    profile_add(&profile.spawn_ns, t0);
+    profile.spawns++;
+  }
+  if (pid == 0) {
+    job_child_setup(0, false);
+    dup2(out[0][1], STDOUT_FILENO);
+    exec_command(task, b, exec_path);
+  }
+  if (pid < 0)
+    perror("fork");
+  else
+    job_add_pid(slot->job, pid);
+  if (pid > 0 && job_control)
+    setpgid(pid, pid);
+  close(out[0][1]);
+  return 0;
+}
+
+/**
+ * Write out a finished task's output in one piece and free the slot
+ * @param  slot finished slot
+ * @return      exit code of the task
+ */
+static int parallel_finish(struct parallel_slot *slot) {
+  fflush(stdout);
+  for (size_t off = 0; off < slot->len;) {
+    ssize_t n = write(STDOUT_FILENO, slot->out + off, slot->len - off);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    off += n;
+  }
+  int code = job_exit_code(slot->job);
+  job_free(slot->job);
+  slot->job = NULL;
+  return code;
+}
+
+// parallel [-j N] command [args] ::: inputs: run command once per input,
+// at most N at a time (default: one per CPU; -jN works too). {} in the arguments is
+// replaced by the input, otherwise the input is appended. Each task's
+// stdout is collected and printed in one piece when it finishes, so the
+// outputs of concurrent tasks never interleave. The status is the number
+// of failed tasks. The tasks run in their own process groups while the
+// shell keeps the terminal, so the shell catches SIGINT and SIGTERM,
+// passes them on to every running task and drops the rest of the queue.
+int builtin_parallel(struct command_t *command) {
+  char **args = command->args + 1;
+  long width = sysconf(_SC_NPROCESSORS_ONLN);
+  if (args[0] != NULL && strncmp(args[0], "-j", 2) == 0) {
+    const char *value = args[0][2] ? args[0] + 2 : args[1]; // -jN or -j N
+    char *end = NULL;
+    width = value ? strtol(value, &end, 10) : 0;
+    if (value == NULL || end == value || *end != '\0')
+      width = 0; // reported as a usage error below
+    args += args[0][2] || value == NULL ? 1 : 2;
+  }
+  char **inputs = args;
+  while (*inputs != NULL && strcmp(*inputs, ":::") != 0)
+    inputs++;
+  if (width < 1 || args[0] == NULL || *inputs == NULL) {
+    printf("usage: parallel [-j N] command [args] ::: inputs...\n");
+    last_status = 2;
     return SUCCESS;
   }
+  *inputs++ = NULL; // ends the command template
+  int ninputs = 0;
+  while (inputs[ninputs] != NULL)
+    ninputs++;
+  if (width > ninputs)
+    width = ninputs;
+
+  struct sigaction sa, old_int, old_term;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = parallel_handler;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+  parallel_signal = 0;
+
+  struct parallel_slot *slots = calloc(width, sizeof(*slots));
+  struct pollfd *fds = malloc(sizeof(*fds) * (width + 1));
+  int next = 0, running = 0, failed = 0, forwarded = 0;
+  while (next < ninputs || running > 0) {
+    if (parallel_signal != forwarded) { // pass it on, start nothing new
+      forwarded = parallel_signal;
+      for (int i = 0; i < width; i++)
+        if (slots[i].job != NULL)
+          job_kill(slots[i].job, forwarded);
+      next = ninputs;
+    }
+
+    // fill the free slots from the queue
+    for (int i = 0; i < width && next < ninputs; i++) {
+      if (slots[i].job != NULL)
+        continue;
+      if (parallel_start(&slots[i], parallel_task(args, inputs[next++])) < 0)
+        failed++;
+      else
+        running++;
+    }
+    if (running == 0)
+      break;
+
+    // wait for output or for a task to exit
+    int nfds = 0;
+    fds[nfds++] = (struct pollfd){.fd = sigchld_pipe[0], .events = POLLIN};
+    for (int i = 0; i < width; i++)
+      fds[nfds++] = (struct pollfd){
+          .fd = slots[i].job ? slots[i].fd : -1, .events = POLLIN};
+    if (poll(fds, nfds, -1) < 0 && errno != EINTR)
+      break;
+
+    for (int i = 0; i < width; i++) {
+      struct parallel_slot *slot = &slots[i];
+      if (slot->job == NULL || !(fds[i + 1].revents & (POLLIN | POLLHUP)))
+        continue;
+      if (slot->cap - slot->len < 4096) {
+        slot->cap = slot->cap ? slot->cap * 2 : 8192;
+        slot->out = realloc(slot->out, slot->cap);
+      }
+      ssize_t n = read(slot->fd, slot->out + slot->len, slot->cap - slot->len);
+      if (n > 0) {
+        slot->len += n;
+      } else if (n == 0 || errno != EINTR) {
+        close(slot->fd);
+        slot->fd = -1;
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      char buf[64];
+      while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+      for (int i = 0; i < width; i++)
+        if (slots[i].job != NULL)
+          job_wait(slots[i].job, WNOHANG);
+    }
+
+    for (int i = 0; i < width; i++) {
+      if (slots[i].job == NULL || slots[i].fd >= 0 || slots[i].job->live > 0)
+        continue;
+      if (parallel_finish(&slots[i]) != 0)
+        failed++;
+      running--;
+    }
+  }
+
+  for (int i = 0; i < width; i++)
+    free(slots[i].out);
+  free(slots);
+  free(fds);
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+  // background jobs may have finished too: let jobs_notify() look again
+  sigchld_handler(SIGCHLD);
+  last_status = failed > 101 ? 101 : failed;
+  if (forwarded != 0) {
+    last_status = 128 + forwarded;
+    if (!job_control) // a script dies of it, as it did before
+      raise(forwarded);
+  }
   return SUCCESS;
 }
 
-int main() {
-  // Register signal handler to automatically reap zombie background processes
-  signal(SIGCHLD, sigchld_handler);
+/* ─── Completion ─── */
+
+// Tab completion. A word in command position completes against a sorted
+// index of the built-ins and of the executables in PATH. The index is
+// merged from per-directory listings kept in the PATH cache's directory
+// list: path_cache_validate() stats the directories at most once per
+// second, and only a directory whose mtime changed is read again, so a
+// slow (e.g. network) PATH entry is not listed on every key press. Other
+// words complete against a cached listing of their directory, re-read
+// only when that directory or its mtime changes.
+#define COMPLETE_LIST_MAX 100 // matches shown when a tab is ambiguous
+
+static const char **complete_commands; // sorted, unique
+static int complete_command_count;
+
+struct complete_dir {
+  char *path; // directory as typed, "" for the current one
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  char **names; // sorted; directories end in '/'
+  int count;
+};
+
+static struct complete_dir complete_dir;
+
+static int complete_compare(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * Read the executables of one PATH directory into its cache entry
+ * @param d PATH cache directory
+ */
+static void complete_list_dir(struct path_cache_dir *d) {
+  for (int i = 0; i < d->exec_count; i++)
+    free(d->execs[i]);
+  d->exec_count = 0;
+  d->listed = true;
+  d->listed_mtime = d->mtime;
+
+  DIR *dir = opendir(d->dir);
+  if (dir == NULL)
+    return;
+  int cap = 0;
+  struct dirent *e;
+  while ((e = readdir(dir)) != NULL) {
+    if (e->d_name[0] == '.' || e->d_type == DT_DIR)
+      continue;
+    struct stat st;
+    if (fstatat(dirfd(dir), e->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode) ||
+        faccessat(dirfd(dir), e->d_name, X_OK, 0) < 0)
+      continue;
+    if (d->exec_count == cap) {
+      cap = cap ? 2 * cap : 64;
+      d->execs = realloc(d->execs, sizeof(char *) * cap);
+    }
+    d->execs[d->exec_count++] = strdup(e->d_name);
+  }
+  closedir(dir);
+}
+
+/**
+ * Bring the command index up to date, re-reading only changed directories
+ */
+static void complete_refresh_commands() {
+  path_cache_validate();
+  bool changed = complete_commands == NULL;
+  int total = sizeof(builtins) / sizeof(builtins[0]);
+  for (int i = 0; i < path_cache_dir_count; i++) {
+    struct path_cache_dir *d = &path_cache_dirs[i];
+    if (!d->listed || !path_cache_same_mtime(d->listed_mtime, d->mtime)) {
+      complete_list_dir(d);
+      changed = true;
+    }
+    total += d->exec_count;
+  }
+  if (!changed)
+    return;
+
+  // the index points into the listings and the built-in table
+  complete_commands = realloc(complete_commands, sizeof(char *) * total);
+  int n = 0;
+  for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    complete_commands[n++] = builtins[i].name;
+  for (int i = 0; i < path_cache_dir_count; i++)
+    for (int j = 0; j < path_cache_dirs[i].exec_count; j++)
+      complete_commands[n++] = path_cache_dirs[i].execs[j];
+  qsort(complete_commands, n, sizeof(char *), complete_compare);
+  complete_command_count = 0;
+  for (int i = 0; i < n; i++)
+    if (i == 0 || strcmp(complete_commands[i], complete_commands[i - 1]))
+      complete_commands[complete_command_count++] = complete_commands[i];
+}
+
+/**
+ * Bring the listing of a directory up to date
+ * @param  path directory as typed, "" for the current one
+ * @return      0, or -1 if it cannot be read
+ */
+static int complete_refresh_dir(const char *path) {
+  const char *open_path = *path ? path : ".";
+  struct stat st;
+  if (stat(open_path, &st) < 0)
+    return -1;
+  struct complete_dir *c = &complete_dir;
+  if (c->path != NULL && strcmp(c->path, path) == 0 && c->dev == st.st_dev &&
+      c->ino == st.st_ino && path_cache_same_mtime(c->mtime, st.st_mtim))
+    return 0; // same directory, unchanged since it was listed
+
+  DIR *dir = opendir(open_path);
+  if (dir == NULL)
+    return -1;
+  for (int i = 0; i < c->count; i++)
+    free(c->names[i]);
+  free(c->path);
+  c->path = strdup(path);
+  c->dev = st.st_dev;
+  c->ino = st.st_ino;
+  c->mtime = st.st_mtim;
+  c->count = 0;
+
+  int cap = 0;
+  struct dirent *e;
+  while ((e = readdir(dir)) != NULL) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+      continue;
+    bool is_dir = e->d_type == DT_DIR;
+    struct stat est;
+    if (e->d_type == DT_UNKNOWN || e->d_type == DT_LNK)
+      is_dir = fstatat(dirfd(dir), e->d_name, &est, 0) == 0 &&
+               S_ISDIR(est.st_mode);
+    if (c->count == cap) {
+      cap = cap ? 2 * cap : 64;
+      c->names = realloc(c->names, sizeof(char *) * cap);
+    }
+    size_t len = strlen(e->d_name);
+    char *name = malloc(len + 2);
+    memcpy(name, e->d_name, len);
+    if (is_dir)
+      name[len++] = '/';
+    name[len] = '\0';
+    c->names[c->count++] = name;
+  }
+  closedir(dir);
+  qsort(c->names, c->count, sizeof(char *), complete_compare);
+  return 0;
+}
+
+/**
+ * Find the names starting with a prefix in a sorted array
+ * @param  names  sorted names
+ * @param  count  number of names
+ * @param  prefix prefix to match
+ * @param  lo     set to the first match
+ * @return        number of matches
+ */
+static int complete_range(const char *const *names, int count,
+                          const char *prefix, int *lo) {
+  size_t len = strlen(prefix);
+  int l = 0, h = count;
+  while (l < h) { // first name >= prefix
+    int mid = (l + h) / 2;
+    if (strcmp(names[mid], prefix) < 0)
+      l = mid + 1;
+    else
+      h = mid;
+  }
+  *lo = l;
+  for (h = l; h < count && strncmp(names[h], prefix, len) == 0; h++)
+    ;
+  return h - l;
+}
+
+/**
+ * Complete the word before the end of the line: the longest common
+ * prefix of the matches is inserted, plus a space once the match is
+ * unique. When nothing can be inserted the matches are listed.
+ * @param buf   line buffer (4096 bytes), NUL-terminated at *index
+ * @param index length of the line, updated
+ */
+void complete_line(char *buf, int *index) {
+  // the word: everything after the last unescaped separator
+  int start = *index;
+  while (start > 0 && (!strchr(" \t|&<>", buf[start - 1]) ||
+                       (start > 1 && buf[start - 2] == '\\')))
+    start--;
+  int before = start;
+  while (before > 0 && (buf[before - 1] == ' ' || buf[before - 1] == '\t'))
+    before--;
+  bool command_position = before == 0 || buf[before - 1] == '|';
+
+  char word[4096];
+  int wlen = 0;
+  for (int i = start; i < *index; i++) // typed escapes do not count
+    if (buf[i] != '\\' || (i > start && buf[i - 1] == '\\'))
+      word[wlen++] = buf[i];
+  word[wlen] = '\0';
+
+  const char *const *names;
+  int count;
+  const char *base = word;
+  char *slash = strrchr(word, '/');
+  if (command_position && slash == NULL) {
+    complete_refresh_commands();
+    names = complete_commands;
+    count = complete_command_count;
+  } else {
+    char dir[4096] = "";
+    if (slash != NULL) {
+      memcpy(dir, word, slash - word + 1);
+      dir[slash - word + 1] = '\0';
+      base = slash + 1;
+    }
+    if (complete_refresh_dir(dir) < 0) {
+      putchar('\a');
+      return;
+    }
+    names = (const char *const *)complete_dir.names;
+    count = complete_dir.count;
+  }
+
+  int lo, total = complete_range(names, count, base, &lo);
+  const char **match = malloc(sizeof(char *) * (total + 1));
+  int n = 0;
+  for (int i = lo; i < lo + total; i++)
+    if (*base == '.' || names[i][0] != '.') // hidden files only if asked
+      match[n++] = names[i];
+  if (n == 0) {
+    putchar('\a');
+    free(match);
+    return;
+  }
+
+  // longest common prefix of all matches, beyond what was typed
+  size_t typed = strlen(base), common = strlen(match[0]);
+  for (int i = 1; i < n; i++) {
+    size_t k = typed;
+    while (k < common && match[i][k] == match[0][k])
+      k++;
+    common = k;
+  }
+
+  const char *add = match[0] + typed;
+  size_t add_len = common - typed;
+  for (size_t i = 0; i < add_len && *index < 4093; i++) {
+    if (strchr(" \t|&<>'\"\\#", add[i])) { // keep it one word
+      buf[(*index)++] = '\\';
+      putchar('\\');
+    }
+    buf[(*index)++] = add[i];
+    putchar(add[i]);
+  }
+  if (n == 1 && match[0][common - 1] != '/' && *index < 4095) {
+    buf[(*index)++] = ' ';
+    putchar(' ');
+  }
+  buf[*index] = '\0';
+
+  if (n > 1 && add_len == 0) { // ambiguous: show the candidates
+    putchar('\n');
+    for (int i = 0; i < n && i < COMPLETE_LIST_MAX; i++)
+      printf("%s  ", match[i]);
+    if (n > COMPLETE_LIST_MAX)
+      printf("... (%d more)", n - COMPLETE_LIST_MAX);
+    putchar('\n');
+    show_prompt();
+    printf("%s", buf);
+  }
+  free(match);
+}
+
+/* ─── Non-interactive Mode ─── */
+
+#define SCRIPT_READ_BLOCK (64 * 1024)
+
+/**
+ * Parse and run one line of a script or -c string
+ * @param  line command line, without the newline
+ * @return      EXIT if the line ran `exit`, SUCCESS otherwise
+ */
+static int run_line(char *line) {
+  struct command_t *command =
+      arena_alloc(&line_arena, sizeof(struct command_t)); // zeroed
+  int code = SUCCESS;
+  jobs_notify();
+  long t0 = profile_start();
+  int parsed = parse_command(line, command);
+  profile_add(&profile.parse_ns, t0);
+  if (parsed == 0)
+    code = process_command(command);
+  profile_report();
+  free_command(command);
+  return code;
+}
+
+/**
+ * Run every line of a -c argument
+ * @param  script commands separated by newlines
+ * @return        exit status of the shell
+ */
+static int run_string(const char *script) {
+  char *copy = strdup(script);
+  int code = SUCCESS;
+  for (char *line = copy; line != NULL && code != EXIT;) {
+    char *nl = strchr(line, '\n');
+    if (nl != NULL)
+      *nl = '\0';
+    code = run_line(line);
+    line = nl ? nl + 1 : NULL;
+  }
+  free(copy);
+  return last_status;
+}
+
+/**
+ * Run a script read from a file descriptor without a terminal: input is
+ * read in large blocks and split into lines in place, and no prompt or
+ * termios calls are made. Since the script is read ahead, a script that
+ * arrives on stdin is moved to another descriptor first and the commands
+ * get /dev/null as their stdin (see main()).
+ * @param  fd script (a file, or a copy of a non-terminal stdin)
+ * @return    exit status of the shell
+ */
+static int run_script(int fd) {
+  size_t cap = SCRIPT_READ_BLOCK, len = 0, pos = 0;
+  char *buf = malloc(cap + 1);
+  bool eof = false;
+
+  while (1) {
+    char *nl = memchr(buf + pos, '\n', len - pos);
+    if (nl == NULL && !eof) {
+      // keep the partial line, make room and read the next block
+      memmove(buf, buf + pos, len - pos);
+      len -= pos;
+      pos = 0;
+      if (cap - len < SCRIPT_READ_BLOCK / 2) {
+        cap *= 2;
+        buf = realloc(buf, cap + 1);
+      }
+      ssize_t n = read(fd, buf + len, cap - len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        eof = true;
+      else
+        len += n;
+      continue;
+    }
+    if (nl == NULL && pos == len)
+      break; // EOF after the last line
+
+    char *line = buf + pos;
+    size_t line_len = nl ? (size_t)(nl - line) : len - pos;
+    line[line_len] = '\0'; // the buffer has one spare byte for this
+    pos += line_len + (nl ? 1 : 0);
+    if (run_line(line) == EXIT)
+      break;
+  }
+  free(buf);
+  return last_status;
+}
+
+static void shell_sigint_handler(int sig) {
+  (void)sig;
+  shell_interrupted = 1;
+}
+
+/**
+ * Put the interactive shell into its own process group in the foreground
+ * of the terminal, so that jobs can be given the terminal and stopped.
+ * Ctrl+C that reaches the shell itself (at the prompt, or while a built-in
+ * runs in the shell process) only interrupts the blocking call: the
+ * handler is installed without SA_RESTART and just sets a flag.
+ */
+static void job_control_init() {
+  // wait until we are in the foreground if started from another shell
+  while (tcgetpgrp(STDIN_FILENO) != getpgrp())
+    kill(-getpgrp(), SIGTTIN);
+
+  signal(SIGTSTP, SIG_IGN);
+  signal(SIGTTIN, SIG_IGN);
+  signal(SIGTTOU, SIG_IGN);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = shell_sigint_handler;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  setpgid(0, 0); // fails harmlessly when already a session leader
+  shell_pgid = getpgrp();
+  tcsetpgrp(STDIN_FILENO, shell_pgid);
+  job_control = true;
+}
+
+int main(int argc, char *argv[]) {
+  shell_pid = getpid();
+
+  if (argc > 1 && strcmp(argv[1], "--profile") == 0) {
+    profile.enabled = true;
+    argv++;
+    argc--;
+  }
+
+  // SIGCHLD only wakes the job table; children are reaped between commands
+  jobs_init();
+
+  // shellish -c 'commands', shellish script, or a non-terminal stdin
+  if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+    if (argc < 3) {
+      fprintf(stderr, "%s: -c: option requires an argument\n", sysname);
+      return 2;
+    }
+    return run_string(argv[2]);
+  }
+  if (argc > 1) {
+    int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      fprintf(stderr, "%s: %s: %s\n", sysname, argv[1], strerror(errno));
+      return 127;
+    }
+    int code = run_script(fd);
+    close(fd);
+    return code;
+  }
+  if (!isatty(STDIN_FILENO)) {
+    // commands would otherwise read whatever part of the script has not
+    // been read ahead yet
+    int null = open("/dev/null", O_RDONLY);
+    int fd = null < 0 ? -1 : fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (fd < 0)
+      return run_script(STDIN_FILENO);
+    dup2(null, STDIN_FILENO);
+    close(null);
+    int code = run_script(fd);
+    close(fd);
+    return code;
+  }
 
+  job_control_init();
   while (1) {
     struct command_t *command =
-        (struct command_t *)malloc(sizeof(struct command_t));
-    memset(command, 0, sizeof(struct command_t)); // set all bytes to 0
+        arena_alloc(&line_arena, sizeof(struct command_t)); // zeroed
 
     int code;
+    jobs_notify();
     code = prompt(command);
     if (code == EXIT)
       break;
 
     code = process_command(command);
+    profile_report();
     if (code == EXIT)
       break;
 
@@ -0,0 +1,44 @@
+#ifndef SHELLISH_H
+#define SHELLISH_H
+
+#include <stdbool.h>
+
+// Shared between the shell (shellish-skeleton.c), the built-ins that live
+// in their own files and the benchmark harness (bench.c).
+
+struct command_t {
+  char *name;
+  bool background;
+  int arg_count;
+  char **args;
+  char *redirects[3];     // in/out redirection
+  struct command_t *next; // for piping
+};
+
+/**
+ * Parse a command line into a zeroed first stage
+ * @param  buf     command line
+ * @param  command zeroed first stage, filled in
+ * @return         0, or -1 on a syntax error (command->name is then "")
+ */
+int parse_command(char *buf, struct command_t *command);
+
+/**
+ * Run a parsed command line
+ * @param  command first stage
+ * @return         SUCCESS, or EXIT when the shell should exit
+ */
+int process_command(struct command_t *command);
+
+/**
+ * Release a parsed command line
+ * @param  command first stage
+ * @return         0
+ */
+int free_command(struct command_t *command);
+
+// built-ins with their own source files
+void handle_cut(int argc, char *argv[]);  // my_cut.c
+int chatroom(int argc, char *argv[]);     // chatroom.c
+
+#endif
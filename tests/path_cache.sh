@@ -0,0 +1,23 @@
+#!/bin/sh
+# A command hashed from a later PATH directory must be found again in an
+# earlier one once a shadowing executable appears there, even when that
+# happens within the same second as the lookup that filled the cache.
+set -e
+shell=${1:-./shellish}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+mkdir "$dir/pa" "$dir/pb"
+printf '#!/bin/sh\necho pb\n' > "$dir/pb/tool"
+printf '#!/bin/sh\necho pa\n' > "$dir/shadow"
+chmod +x "$dir/pb/tool" "$dir/shadow"
+
+out=$(printf 'tool\ncp %s %s\nsleep 1.1\ntool\n' \
+        "$dir/shadow" "$dir/pa/tool" |
+      PATH="$dir/pa:$dir/pb:$PATH" "$shell")
+expected=$(printf 'pb\npa')
+if [ "$out" != "$expected" ]; then
+  echo "path_cache: expected pb then pa, got:" >&2
+  echo "$out" >&2
+  exit 1
+fi
+echo "path_cache: ok"